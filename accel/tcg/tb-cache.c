@@ -0,0 +1,585 @@
+/*
+ * Persistent translation block cache for user-mode emulation
+ *
+ * Short-lived processes spend much of their time translating code that
+ * the previous run of the same binary already translated.  The cache
+ * saves the used part of code_gen_buffer, which also holds the TB
+ * descriptors, together with the guest code each TB was translated from.
+ *
+ * Generated code is not relocatable: it calls helpers and jumps to the
+ * epilogue at absolute or PC-relative addresses.  A cache file is thus
+ * only loaded by a process with the same backend identifier (see
+ * tcg_backend_id()), which in practice means the same statically linked
+ * QEMU binary running on a host with the same instruction set extensions,
+ * and the same guest_base.  The restored image is copied
+ * back at the same address, and TBs stay dormant until a lookup for their
+ * pc misses: only then, and only if the guest code still matches, are
+ * they linked into the page lists and hash table.
+ *
+ * Since the backend identifier includes the addresses of QEMU's own
+ * text and data, a position independent QEMU only ever hits the cache
+ * when address space layout randomization is disabled.
+ *
+ * The cache holds host code that is run as is, so it is only used
+ * when nobody else could have planted it: the directory and its files
+ * must belong to the effective user and must not be writable by group
+ * or others, and each file carries an HMAC keyed with a secret stored
+ * next to it.  Set-user-ID runs do not use the cache at all.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
+#include "exec/tb-cache.h"
+#include "qemu/error-report.h"
+#include "elf.h"
+#include "tcg.h"
+#include "translate-all.h"
+#include "trace.h"
+
+#define TB_CACHE_MAGIC      "QEMUTBC"
+#define TB_CACHE_VERSION    3
+#define TB_CACHE_ID_LEN     64
+#define TB_CACHE_KEY_LEN    32
+/* HMAC-SHA256 of everything before it, at the end of the file */
+#define TB_CACHE_MAC_LEN    32
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nb_tbs;
+    /* also part of backend_id, kept apart to tell why a cache is rejected */
+    uint64_t host_features;
+    char backend_id[TB_CACHE_ID_LEN];
+    char exec_id[TB_CACHE_ID_LEN];
+    uint64_t guest_base;
+    uint64_t code_start;
+    uint64_t code_size;
+} TBCacheHeader;
+
+/*
+ * Each TB is described by its offset in the code image, followed by the
+ * tb->size bytes of guest code it was translated from.
+ */
+typedef struct TBCacheRecord {
+    uint64_t offset;
+} TBCacheRecord;
+
+typedef struct TBCachePending {
+    TranslationBlock *tb;       /* NULL once adopted */
+    const uint8_t *guest_code;
+} TBCachePending;
+
+static struct {
+    char *path;
+    char *backend_id;
+    char *exec_id;
+    /* contents of the cache file; guest code of pending TBs points here */
+    char *data;
+    /* guest pc -> GSList of TBCachePending */
+    GHashTable *pending;
+    /* end of the restored image, NULL if nothing is restored */
+    void *code_end;
+    uint8_t key[TB_CACHE_KEY_LEN];
+} tb_cache;
+
+static bool tb_cache_read_full(int fd, void *buf, size_t len)
+{
+    while (len) {
+        ssize_t ret = read(fd, buf, len);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+/*
+ * Open @path for reading if it is a regular file owned by the effective
+ * user, with none of the permission bits in @mask set.  Returns -1 with
+ * errno set otherwise.
+ */
+static int tb_cache_open_private(const char *path, mode_t mask,
+                                 struct stat *st)
+{
+    int fd = qemu_open(path, O_RDONLY | O_NOFOLLOW);
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(st->st_mode) || st->st_uid != geteuid() ||
+        (st->st_mode & mask)) {
+        close(fd);
+        errno = EPERM;
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Read the HMAC key from @dir, creating it on first use.  A new key is
+ * linked into place only once it is complete, so concurrent runs agree
+ * on whichever key got there first.
+ */
+static bool tb_cache_load_key(const char *dir)
+{
+    char *path = g_strdup_printf("%s/key", dir);
+    char *tmp = NULL;
+    struct stat st;
+    bool ok = false;
+    int fd;
+
+    fd = tb_cache_open_private(path, S_IRWXG | S_IRWXO, &st);
+    if (fd < 0 && errno == ENOENT) {
+        uint8_t key[TB_CACHE_KEY_LEN];
+        int rfd = qemu_open("/dev/urandom", O_RDONLY);
+
+        if (rfd < 0) {
+            goto out;
+        }
+        ok = tb_cache_read_full(rfd, key, sizeof(key));
+        close(rfd);
+        if (!ok) {
+            goto out;
+        }
+
+        tmp = g_strdup_printf("%s.XXXXXX", path);
+        fd = g_mkstemp(tmp);
+        if (fd < 0) {
+            ok = false;
+            goto out;
+        }
+        ok = qemu_write_full(fd, key, sizeof(key)) == sizeof(key);
+        close(fd);
+        if (ok && link(tmp, path) < 0 && errno != EEXIST) {
+            ok = false;
+        }
+        unlink(tmp);
+        if (!ok) {
+            goto out;
+        }
+        fd = tb_cache_open_private(path, S_IRWXG | S_IRWXO, &st);
+    }
+    ok = false;
+    if (fd >= 0) {
+        ok = st.st_size == TB_CACHE_KEY_LEN &&
+             tb_cache_read_full(fd, tb_cache.key, TB_CACHE_KEY_LEN);
+        close(fd);
+    }
+
+out:
+    g_free(tmp);
+    g_free(path);
+    return ok;
+}
+
+/*
+ * Check that the cache may be used at all: not by a set-user-ID or
+ * set-group-ID run, and only in a directory that nobody but the
+ * effective user can add files to.
+ */
+static const char *tb_cache_check_dir(const char *dir)
+{
+    struct stat st;
+
+    if (getuid() != geteuid() || getgid() != getegid() ||
+        qemu_getauxval(AT_SECURE)) {
+        return "not used by privileged processes";
+    }
+    if (stat(dir, &st) < 0 || !S_ISDIR(st.st_mode)) {
+        return "not a directory";
+    }
+    if (st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        return "directory must be owned and only writable by the user";
+    }
+    if (!tb_cache_load_key(dir)) {
+        return "cannot read or create the key";
+    }
+    return NULL;
+}
+
+static void tb_cache_mac(const char *data, size_t len,
+                         uint8_t mac[TB_CACHE_MAC_LEN])
+{
+    GHmac *hmac = g_hmac_new(G_CHECKSUM_SHA256, tb_cache.key,
+                             TB_CACHE_KEY_LEN);
+    gsize mac_len = TB_CACHE_MAC_LEN;
+
+    g_hmac_update(hmac, (const guchar *)data, len);
+    g_hmac_get_digest(hmac, mac, &mac_len);
+    g_hmac_unref(hmac);
+}
+
+/*
+ * Identify the guest executable and the QEMU binary running it.  Both
+ * are identified by their inode and modification time rather than by
+ * hashing their contents, which would cost as much as some of the runs
+ * the cache is meant to speed up; the guest code is compared anyway
+ * before a TB is reused.
+ */
+static char *tb_cache_exec_id(const char *exec_path)
+{
+    struct stat self, exe;
+    uint64_t data[8];
+    char *real, *id;
+    GChecksum *cs;
+
+    if (stat("/proc/self/exe", &self) < 0 || stat(exec_path, &exe) < 0) {
+        return NULL;
+    }
+    real = realpath(exec_path, NULL);
+    if (!real) {
+        return NULL;
+    }
+
+    data[0] = self.st_dev;
+    data[1] = self.st_ino;
+    data[2] = self.st_size;
+    data[3] = self.st_mtime;
+    data[4] = exe.st_dev;
+    data[5] = exe.st_ino;
+    data[6] = exe.st_size;
+    data[7] = exe.st_mtime;
+
+    cs = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(cs, (const guchar *)TARGET_NAME, strlen(TARGET_NAME));
+    g_checksum_update(cs, (const guchar *)real, strlen(real));
+    g_checksum_update(cs, (const guchar *)data, sizeof(data));
+    id = g_strdup(g_checksum_get_string(cs));
+    g_checksum_free(cs);
+    free(real);
+    return id;
+}
+
+static void tb_cache_add_pending(TranslationBlock *tb, const uint8_t *code)
+{
+    TBCachePending *p = g_new(TBCachePending, 1);
+    uint64_t pc = tb->pc;
+    GSList *list;
+
+    p->tb = tb;
+    p->guest_code = code;
+
+    list = g_hash_table_lookup(tb_cache.pending, &pc);
+    if (list) {
+        /* the head of the list stays the same */
+        list = g_slist_append(list, p);
+    } else {
+        g_hash_table_insert(tb_cache.pending, g_memdup(&pc, sizeof(pc)),
+                            g_slist_prepend(NULL, p));
+    }
+}
+
+static const char *tb_cache_parse(const char *data, size_t len)
+{
+    const TBCacheHeader *hdr = (const TBCacheHeader *)data;
+    void *start = tcg_ctx->code_gen_ptr;
+    uint8_t mac[TB_CACHE_MAC_LEN];
+    const char *p;
+    uint32_t i;
+
+    if (len < sizeof(*hdr) + TB_CACHE_MAC_LEN ||
+        memcmp(hdr->magic, TB_CACHE_MAGIC, 8)) {
+        return "bad magic";
+    }
+    len -= TB_CACHE_MAC_LEN;
+    tb_cache_mac(data, len, mac);
+    if (memcmp(mac, data + len, TB_CACHE_MAC_LEN)) {
+        return "bad MAC";
+    }
+    if (hdr->version != TB_CACHE_VERSION) {
+        return "version mismatch";
+    }
+    if (hdr->host_features != tcg_backend_features()) {
+        return "host feature mismatch";
+    }
+    if (memcmp(hdr->backend_id, tb_cache.backend_id, TB_CACHE_ID_LEN) ||
+        memcmp(hdr->exec_id, tb_cache.exec_id, TB_CACHE_ID_LEN)) {
+        return "binary mismatch";
+    }
+    if (hdr->guest_base != guest_base) {
+        return "guest_base mismatch";
+    }
+    if (hdr->code_start != (uintptr_t)start) {
+        return "code buffer mismatch";
+    }
+    if (hdr->code_size > tcg_ctx->code_gen_highwater - start ||
+        hdr->code_size > len - sizeof(*hdr)) {
+        return "truncated code";
+    }
+
+    /* Validate all records before touching the code buffer */
+    p = data + sizeof(*hdr) + hdr->code_size;
+    for (i = 0; i < hdr->nb_tbs; i++) {
+        const TranslationBlock *tb;
+        TBCacheRecord rec;
+
+        if (data + len - p < sizeof(rec)) {
+            return "truncated records";
+        }
+        memcpy(&rec, p, sizeof(rec));
+        p += sizeof(rec);
+        if (rec.offset > hdr->code_size - sizeof(*tb) ||
+            rec.offset % __alignof__(TranslationBlock)) {
+            return "bad record";
+        }
+        tb = (const TranslationBlock *)(data + sizeof(*hdr) + rec.offset);
+        if (data + len - p < tb->size) {
+            return "truncated records";
+        }
+        p += tb->size;
+    }
+
+    memcpy(start, data + sizeof(*hdr), hdr->code_size);
+    tb_cache.code_end = start + hdr->code_size;
+    tcg_ctx->code_gen_ptr = tb_cache.code_end;
+    flush_icache_range((uintptr_t)start, (uintptr_t)tb_cache.code_end);
+
+    p = data + sizeof(*hdr) + hdr->code_size;
+    for (i = 0; i < hdr->nb_tbs; i++) {
+        TranslationBlock *tb;
+        TBCacheRecord rec;
+
+        memcpy(&rec, p, sizeof(rec));
+        p += sizeof(rec);
+        tb = start + rec.offset;
+        tb_cache_add_pending(tb, (const uint8_t *)p);
+        p += tb->size;
+    }
+    return NULL;
+}
+
+void tb_cache_load(const char *dir, const char *exec_path)
+{
+    const char *err;
+    struct stat st;
+    size_t len;
+    int fd;
+
+    g_assert(tcg_ctx->code_gen_ptr == tcg_ctx->code_gen_buffer);
+
+    err = tb_cache_check_dir(dir);
+    if (err) {
+        warn_report("Not using TB cache %s: %s", dir, err);
+        return;
+    }
+    tb_cache.exec_id = tb_cache_exec_id(exec_path);
+    if (!tb_cache.exec_id) {
+        return;
+    }
+    tb_cache.backend_id = tcg_backend_id();
+    g_assert(strlen(tb_cache.backend_id) == TB_CACHE_ID_LEN);
+    tb_cache.path = g_strdup_printf("%s/%s.tbc", dir, tb_cache.exec_id);
+    tb_cache.pending = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                             g_free, NULL);
+
+    fd = tb_cache_open_private(tb_cache.path, S_IWGRP | S_IWOTH, &st);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            trace_tb_cache_reject(tb_cache.path, strerror(errno));
+        }
+        return;
+    }
+    len = st.st_size;
+    tb_cache.data = g_try_malloc(len);
+    if (!tb_cache.data || !tb_cache_read_full(fd, tb_cache.data, len)) {
+        close(fd);
+        trace_tb_cache_reject(tb_cache.path, "read error");
+        return;
+    }
+    close(fd);
+    err = tb_cache_parse(tb_cache.data, len);
+    if (err) {
+        trace_tb_cache_reject(tb_cache.path, err);
+        return;
+    }
+    trace_tb_cache_load(tb_cache.path,
+                        ((const TBCacheHeader *)tb_cache.data)->nb_tbs);
+}
+
+/*
+ * Called from tb_gen_code() with mmap_lock held, before translating
+ * a TB that was not found by the normal lookup.
+ */
+TranslationBlock *tb_cache_adopt(target_ulong pc, target_ulong cs_base,
+                                 uint32_t flags, uint32_t cflags,
+                                 uint32_t trace_vcpu_dstate)
+{
+    uint64_t key = pc;
+    GSList *l;
+
+    if (!tb_cache.code_end) {
+        return NULL;
+    }
+
+    for (l = g_hash_table_lookup(tb_cache.pending, &key); l; l = l->next) {
+        TBCachePending *p = l->data;
+        TranslationBlock *tb = p->tb;
+
+        if (!tb || tb->pc != pc || tb->cs_base != cs_base ||
+            tb->flags != flags ||
+            (tb->cflags & CF_HASH_MASK) != (cflags & CF_HASH_MASK) ||
+            tb->trace_vcpu_dstate != trace_vcpu_dstate) {
+            continue;
+        }
+        if (page_check_range(pc, tb->size, 0) < 0 ||
+            memcmp(g2h(pc), p->guest_code, tb->size)) {
+            continue;
+        }
+        p->tb = NULL;
+        trace_tb_cache_adopt(tb, pc);
+        return tb_link_cached(tb);
+    }
+    return NULL;
+}
+
+/* Called on tb_flush(), which recycles the buffer holding the image */
+void tb_cache_reset(void)
+{
+    if (tb_cache.code_end) {
+        g_hash_table_remove_all(tb_cache.pending);
+        tb_cache.code_end = NULL;
+    }
+}
+
+static bool tb_cache_persistent(const TranslationBlock *tb)
+{
+    return !(tb_cflags(tb) & (CF_INVALID | CF_NOCACHE | CF_NOPERSIST));
+}
+
+static gboolean tb_cache_collect_iter(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    TranslationBlock *tb = value;
+    GPtrArray *tbs = data;
+
+    /* guest code must still be mapped since the TB is valid */
+    if (tb_cache_persistent(tb)) {
+        g_ptr_array_add(tbs, tb);
+        g_ptr_array_add(tbs, g2h(tb->pc));
+    }
+    return false;
+}
+
+static void tb_cache_collect_pending(gpointer key, gpointer value,
+                                     gpointer data)
+{
+    GPtrArray *tbs = data;
+    GSList *l;
+
+    for (l = value; l; l = l->next) {
+        TBCachePending *p = l->data;
+
+        if (p->tb) {
+            g_ptr_array_add(tbs, p->tb);
+            g_ptr_array_add(tbs, (gpointer)p->guest_code);
+        }
+    }
+}
+
+void tb_cache_save(void)
+{
+    void *start = tcg_ctx->code_gen_buffer;
+    void *end;
+    TBCacheHeader hdr = { .magic = TB_CACHE_MAGIC };
+    uint8_t mac[TB_CACHE_MAC_LEN];
+    gsize mac_len = sizeof(mac);
+    GPtrArray *tbs;
+    GHmac *hmac;
+    char *tmp = NULL;
+    int fd = -1;
+    guint i;
+
+    if (!tb_cache.path) {
+        return;
+    }
+
+    mmap_lock();
+    end = tcg_ctx->code_gen_ptr;
+    if (end == tb_cache.code_end) {
+        /* nothing was translated since the cache was loaded */
+        goto out;
+    }
+
+    /* pairs of (TranslationBlock *, guest code) */
+    tbs = g_ptr_array_new();
+    tcg_tb_foreach(tb_cache_collect_iter, tbs);
+    if (tb_cache.code_end) {
+        g_hash_table_foreach(tb_cache.pending, tb_cache_collect_pending, tbs);
+    }
+
+    hdr.version = TB_CACHE_VERSION;
+    hdr.nb_tbs = tbs->len / 2;
+    hdr.host_features = tcg_backend_features();
+    memcpy(hdr.backend_id, tb_cache.backend_id, TB_CACHE_ID_LEN);
+    memcpy(hdr.exec_id, tb_cache.exec_id, TB_CACHE_ID_LEN);
+    hdr.guest_base = guest_base;
+    hdr.code_start = (uintptr_t)start;
+    hdr.code_size = end - start;
+
+    /* Write to a temporary file so that concurrent runs never see a
+     * partial cache, then atomically replace the old one.  */
+    tmp = g_strdup_printf("%s.XXXXXX", tb_cache.path);
+    fd = g_mkstemp(tmp);
+    if (fd < 0) {
+        goto out_free;
+    }
+    hmac = g_hmac_new(G_CHECKSUM_SHA256, tb_cache.key, TB_CACHE_KEY_LEN);
+    g_hmac_update(hmac, (const guchar *)&hdr, sizeof(hdr));
+    g_hmac_update(hmac, start, hdr.code_size);
+    if (qemu_write_full(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        qemu_write_full(fd, start, hdr.code_size) != hdr.code_size) {
+        goto out_unref;
+    }
+    for (i = 0; i < tbs->len; i += 2) {
+        TranslationBlock *tb = g_ptr_array_index(tbs, i);
+        TBCacheRecord rec = { .offset = (void *)tb - start };
+        const guchar *code = g_ptr_array_index(tbs, i + 1);
+
+        g_hmac_update(hmac, (const guchar *)&rec, sizeof(rec));
+        g_hmac_update(hmac, code, tb->size);
+        if (qemu_write_full(fd, &rec, sizeof(rec)) != sizeof(rec) ||
+            qemu_write_full(fd, code, tb->size) != tb->size) {
+            goto out_unref;
+        }
+    }
+    g_hmac_get_digest(hmac, mac, &mac_len);
+    g_hmac_unref(hmac);
+    if (qemu_write_full(fd, mac, sizeof(mac)) != sizeof(mac)) {
+        goto out_unlink;
+    }
+    if (close(fd) < 0 || rename(tmp, tb_cache.path) < 0) {
+        fd = -1;
+        goto out_unlink;
+    }
+    trace_tb_cache_save(tb_cache.path, hdr.nb_tbs);
+    goto out_free;
+
+out_unref:
+    g_hmac_unref(hmac);
+out_unlink:
+    if (fd >= 0) {
+        close(fd);
+    }
+    unlink(tmp);
+out_free:
+    g_free(tmp);
+    g_ptr_array_free(tbs, true);
+out:
+    mmap_unlock();
+}
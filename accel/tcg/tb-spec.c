@@ -0,0 +1,250 @@
+/*
+ * Speculative translation of successor blocks for user-mode emulation
+ *
+ * When a vCPU translates a block, the destinations of its direct jumps
+ * (as noted by the front end with translator_note_goto_tb()) are queued
+ * for a background thread, which translates them ahead of time and
+ * inserts them in the TB hash table.  By the time the vCPU leaves the
+ * block, the successor is often ready, so that translation overlaps with
+ * execution instead of stalling the vCPU.
+ *
+ * In user-mode emulation all translations share tcg_init_ctx and are
+ * serialized by mmap_lock, which also keeps the guest mappings stable
+ * while their code is read.  A single worker is therefore used: more
+ * threads would only wait for each other.  Blocks translated by the
+ * worker go through tb_link_page() like any other, so a race with a vCPU
+ * translating the same block just discards one of the two copies.
+ *
+ * Speculation must not slow down the vCPUs it is meant to help.  The
+ * worker holds mmap_lock for one block at a time and yields the CPU
+ * before the next one, so that a vCPU waiting for the lock gets it.
+ * Speculative blocks may also take at most a fraction of the code buffer
+ * between two flushes, so that mispredicted successors do not cause
+ * extra flushes.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/thread.h"
+#include "qemu/rcu.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/tb-spec.h"
+#include "tcg.h"
+#include "translate-all.h"
+#include "trace.h"
+
+/* Pending requests beyond this are dropped */
+#define TB_SPEC_QUEUE_SIZE  256
+/* How many direct jumps ahead of a vCPU the worker may go */
+#define TB_SPEC_MAX_DEPTH   8
+/* Speculative blocks may use up to 1/TB_SPEC_BUFFER_SHARE of the buffer */
+#define TB_SPEC_BUFFER_SHARE 4
+
+typedef struct TBSpecRequest {
+    CPUState *cpu;      /* holds a reference */
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    unsigned int depth;
+} TBSpecRequest;
+
+bool tb_spec_enabled;
+
+static struct {
+    QemuMutex lock;
+    QemuCond cond;
+    QemuThread thread;
+    /*
+     * Used as a stack: the successors of the block a vCPU has just
+     * translated are the most likely to be needed next.
+     */
+    TBSpecRequest queue[TB_SPEC_QUEUE_SIZE];
+    unsigned int count;
+    /* Worker only: code buffer bytes used since flush number flush_count */
+    size_t code_used;
+    unsigned int flush_count;
+} tb_spec;
+
+static void tb_spec_push(CPUState *cpu, target_ulong pc,
+                         const TranslationBlock *tb, uint32_t cflags,
+                         unsigned int depth)
+{
+    TBSpecRequest *req;
+
+    if (tb_spec.count == TB_SPEC_QUEUE_SIZE) {
+        return;
+    }
+    req = &tb_spec.queue[tb_spec.count++];
+    req->cpu = cpu;
+    req->pc = pc;
+    req->cs_base = tb->cs_base;
+    req->flags = tb->flags;
+    req->cflags = cflags;
+    req->depth = depth;
+    object_ref(OBJECT(cpu));
+}
+
+/*
+ * Queue the successors of @tb, which has just been translated for @cpu,
+ * @depth jumps away from the code the vCPU was running.  They are
+ * assumed to run with the same cs_base and flags as @tb; if they do not,
+ * the speculative TB is simply never looked up.
+ *
+ * Called from tb_gen_code() with mmap_lock held, while tcg_ctx still
+ * describes @tb.
+ */
+void tb_spec_enqueue(CPUState *cpu, TranslationBlock *tb, unsigned int depth)
+{
+    uint32_t cflags = tb_cflags(tb);
+    unsigned int mask = tcg_ctx->goto_tb_dest_mask;
+    int n;
+
+    assert_memory_lock();
+    if (depth >= TB_SPEC_MAX_DEPTH ||
+        (cflags & (CF_NOCACHE | CF_COUNT_MASK | CF_LAST_IO))) {
+        return;
+    }
+    cflags &= CF_PARALLEL | CF_USE_ICOUNT;
+
+    qemu_mutex_lock(&tb_spec.lock);
+    if (mask) {
+        for (n = 0; n < 2; n++) {
+            if (mask & (1 << n)) {
+                tb_spec_push(cpu, tcg_ctx->goto_tb_dest[n], tb, cflags,
+                             depth + 1);
+            }
+        }
+    } else {
+        /* Front end did not say; the fall-through is the best guess.  */
+        tb_spec_push(cpu, tb->pc + tb->size, tb, cflags, depth + 1);
+    }
+    qemu_mutex_unlock(&tb_spec.lock);
+    qemu_cond_signal(&tb_spec.cond);
+}
+
+/*
+ * The front end may read a little past the page holding @pc, and the
+ * worker has no way to recover from a host fault, so only translate
+ * blocks whose page and the next one are both mapped and readable.
+ */
+static bool tb_spec_page_ok(target_ulong addr, int prot)
+{
+    int flags = page_get_flags(addr);
+
+    return (flags & PAGE_VALID) && (flags & prot);
+}
+
+/* Called with mmap_lock held */
+static bool tb_spec_buffer_ok(void)
+{
+    unsigned int flush_count = atomic_read(&tb_ctx.tb_flush_count);
+
+    if (flush_count != tb_spec.flush_count) {
+        tb_spec.flush_count = flush_count;
+        tb_spec.code_used = 0;
+    }
+    return tb_spec.code_used < tcg_code_capacity() / TB_SPEC_BUFFER_SHARE;
+}
+
+static void tb_spec_translate(TBSpecRequest *req)
+{
+    TranslationBlock *tb;
+    size_t size;
+
+    rcu_read_lock();
+    mmap_lock();
+    if (!tb_spec_buffer_ok()) {
+        trace_tb_spec_drop(req->pc);
+    } else if (tb_spec_page_ok(req->pc, PAGE_EXEC) &&
+               tb_spec_page_ok(req->pc + TARGET_PAGE_SIZE,
+                               PAGE_READ | PAGE_EXEC) &&
+               !tb_htable_lookup(req->cpu, req->pc, req->cs_base, req->flags,
+                                 req->cflags & CF_HASH_MASK)) {
+        size = tcg_code_size();
+        tb = tb_gen_code_spec(req->cpu, req->pc, req->cs_base, req->flags,
+                              req->cflags, req->depth);
+        /* A flush in between resets the count; a shrink is not a use */
+        if (tcg_code_size() > size) {
+            tb_spec.code_used += tcg_code_size() - size;
+        }
+        trace_tb_spec_translate(tb, req->pc, req->depth);
+    }
+    mmap_unlock();
+    rcu_read_unlock();
+}
+
+static void *tb_spec_thread(void *arg)
+{
+    rcu_register_thread();
+    tcg_register_thread();
+
+    for (;;) {
+        TBSpecRequest req;
+
+        qemu_mutex_lock(&tb_spec.lock);
+        while (tb_spec.count == 0) {
+            qemu_cond_wait(&tb_spec.cond, &tb_spec.lock);
+        }
+        req = tb_spec.queue[--tb_spec.count];
+        qemu_mutex_unlock(&tb_spec.lock);
+
+        tb_spec_translate(&req);
+        object_unref(OBJECT(req.cpu));
+        /* Let vCPUs blocked on mmap_lock in before the next block */
+        sched_yield();
+    }
+    return NULL;
+}
+
+static void tb_spec_start(void)
+{
+    tb_spec.count = 0;
+    tb_spec.code_used = 0;
+    tb_spec.flush_count = atomic_read(&tb_ctx.tb_flush_count);
+    qemu_thread_create(&tb_spec.thread, "tb-spec", tb_spec_thread,
+                       NULL, QEMU_THREAD_DETACHED);
+}
+
+void tb_spec_init(void)
+{
+    qemu_mutex_init(&tb_spec.lock);
+    qemu_cond_init(&tb_spec.cond);
+    tb_spec_start();
+    tb_spec_enabled = true;
+}
+
+/*
+ * Called with mmap_lock held, so the worker is not translating.  Taking
+ * tb_spec.lock as well makes sure it is not halfway through a queue
+ * update when the process forks.
+ */
+void tb_spec_fork_start(void)
+{
+    if (tb_spec_enabled) {
+        qemu_mutex_lock(&tb_spec.lock);
+    }
+}
+
+void tb_spec_fork_end(int child)
+{
+    if (!tb_spec_enabled) {
+        return;
+    }
+    if (child) {
+        /*
+         * The worker did not survive the fork, and the CPUs queued
+         * requests refer to are gone too.  Drop them without touching
+         * their references and start afresh.  The lock is held by this
+         * thread and can be released; the condition variable may have
+         * had the dead worker as a waiter, so it is reinitialized.
+         */
+        qemu_cond_init(&tb_spec.cond);
+        tb_spec_start();
+    }
+    qemu_mutex_unlock(&tb_spec.lock);
+}
@@ -995,3 +995,63 @@ void HELPER(gvec_ussub64)(void *d, void *a, void *b, uint32_t desc)
     }
     clear_high(d, oprsz, desc);
 }
+
+#define DO_MINMAX(NAME, TYPE, OP)                                       \
+void HELPER(NAME)(void *d, void *a, void *b, uint32_t desc)             \
+{                                                                       \
+    intptr_t oprsz = simd_oprsz(desc);                                  \
+    intptr_t i;                                                         \
+    for (i = 0; i < oprsz; i += sizeof(TYPE)) {                         \
+        TYPE aa = *(TYPE *)(a + i);                                     \
+        TYPE bb = *(TYPE *)(b + i);                                     \
+        *(TYPE *)(d + i) = aa OP bb ? aa : bb;                          \
+    }                                                                   \
+    clear_high(d, oprsz, desc);                                         \
+}
+
+DO_MINMAX(gvec_smin8, int8_t, <)
+DO_MINMAX(gvec_smin16, int16_t, <)
+DO_MINMAX(gvec_smin32, int32_t, <)
+DO_MINMAX(gvec_smin64, int64_t, <)
+DO_MINMAX(gvec_umin8, uint8_t, <)
+DO_MINMAX(gvec_umin16, uint16_t, <)
+DO_MINMAX(gvec_umin32, uint32_t, <)
+DO_MINMAX(gvec_umin64, uint64_t, <)
+DO_MINMAX(gvec_smax8, int8_t, >)
+DO_MINMAX(gvec_smax16, int16_t, >)
+DO_MINMAX(gvec_smax32, int32_t, >)
+DO_MINMAX(gvec_smax64, int64_t, >)
+DO_MINMAX(gvec_umax8, uint8_t, >)
+DO_MINMAX(gvec_umax16, uint16_t, >)
+DO_MINMAX(gvec_umax32, uint32_t, >)
+DO_MINMAX(gvec_umax64, uint64_t, >)
+
+#undef DO_MINMAX
+
+/* The shift count of each element is taken modulo the element width.  */
+#define DO_SHV(NAME, TYPE, UTYPE, OP)                                   \
+void HELPER(NAME)(void *d, void *a, void *b, uint32_t desc)             \
+{                                                                       \
+    intptr_t oprsz = simd_oprsz(desc);                                  \
+    intptr_t i;                                                         \
+    for (i = 0; i < oprsz; i += sizeof(TYPE)) {                         \
+        unsigned sh = *(UTYPE *)(b + i) & (sizeof(TYPE) * 8 - 1);       \
+        *(TYPE *)(d + i) = *(TYPE *)(a + i) OP sh;                      \
+    }                                                                   \
+    clear_high(d, oprsz, desc);                                         \
+}
+
+DO_SHV(gvec_shl8v, uint8_t, uint8_t, <<)
+DO_SHV(gvec_shl16v, uint16_t, uint16_t, <<)
+DO_SHV(gvec_shl32v, uint32_t, uint32_t, <<)
+DO_SHV(gvec_shl64v, uint64_t, uint64_t, <<)
+DO_SHV(gvec_shr8v, uint8_t, uint8_t, >>)
+DO_SHV(gvec_shr16v, uint16_t, uint16_t, >>)
+DO_SHV(gvec_shr32v, uint32_t, uint32_t, >>)
+DO_SHV(gvec_shr64v, uint64_t, uint64_t, >>)
+DO_SHV(gvec_sar8v, int8_t, uint8_t, >>)
+DO_SHV(gvec_sar16v, int16_t, uint16_t, >>)
+DO_SHV(gvec_sar32v, int32_t, uint32_t, >>)
+DO_SHV(gvec_sar64v, int64_t, uint64_t, >>)
+
+#undef DO_SHV
@@ -1255,6 +1255,9 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     page_flush_tb();
+#ifdef CONFIG_USER_ONLY
+    tb_cache_reset();
+#endif
 
     tcg_region_reset_all();
     /* XXX: flush processor icache at this point if cache flush is
@@ -1274,6 +1277,56 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+static void tb_evict_one(TranslationBlock *tb)
+{
+    if (!(tb_cflags(tb) & CF_INVALID)) {
+        tb_phys_invalidate(tb, -1);
+    }
+}
+
+/* free one code region, or all of them if none can be evicted */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    CPUState *other;
+    bool done;
+
+    mmap_lock();
+    /* A flush, or an eviction requested by another CPU, made room already */
+    done = tb_ctx.tb_flush_count != tb_flush_count.host_int ||
+           tcg_region_available();
+    if (!done && tcg_region_evict(tb_evict_one)) {
+        /*
+         * Invalidated TBs may still sit in the jump caches, and their
+         * memory is about to be reused.  TBs outside the region are
+         * dropped too, as do_tb_flush() does; they are cheap to find
+         * again from the hash table.
+         */
+        CPU_FOREACH(other) {
+            cpu_tb_jmp_cache_clear(other);
+        }
+        atomic_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + 1);
+        done = true;
+    }
+    mmap_unlock();
+
+    if (!done) {
+        do_tb_flush(cpu, tb_flush_count);
+    }
+}
+
+/*
+ * Make room in the code buffer for @cpu.  This evicts the least recently
+ * used region of code_gen_buffer, or flushes all TBs like tb_flush() when
+ * every region is in use by a TCG context.
+ */
+static void tb_evict(CPUState *cpu)
+{
+    unsigned tb_flush_count = atomic_mb_read(&tb_ctx.tb_flush_count);
+
+    async_safe_run_on_cpu(cpu, do_tb_evict,
+                          RUN_ON_CPU_HOST_INT(tb_flush_count));
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1467,6 +1520,9 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
         if (atomic_read(&cpu->tb_jmp_cache[h]) == tb) {
             atomic_set(&cpu->tb_jmp_cache[h], NULL);
         }
+        if (atomic_read(&cpu->tb_jmp_cache2[h]) == tb) {
+            atomic_set(&cpu->tb_jmp_cache2[h], NULL);
+        }
     }
 
     /* suppress this TB from the two jump lists */
@@ -1667,10 +1723,17 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
     return tb;
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
-TranslationBlock *tb_gen_code(CPUState *cpu,
-                              target_ulong pc, target_ulong cs_base,
-                              uint32_t flags, int cflags)
+/*
+ * Translate a TB; returns NULL if the code buffer is full.  @spec_depth
+ * is how many direct jumps away from the running vCPU the block is, for
+ * speculative translation.
+ *
+ * Called with mmap_lock held for user mode emulation.
+ */
+static TranslationBlock *do_tb_gen_code(CPUState *cpu,
+                                        target_ulong pc, target_ulong cs_base,
+                                        uint32_t flags, int cflags,
+                                        unsigned int spec_depth)
 {
     CPUArchState *env = cpu->env_ptr;
     TranslationBlock *tb, *existing_tb;
@@ -1686,6 +1749,13 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
     phys_pc = get_page_addr_code(env, pc);
 
+#ifdef CONFIG_USER_ONLY
+    tb = tb_cache_adopt(pc, cs_base, flags, cflags, *cpu->trace_dstate);
+    if (tb) {
+        return tb;
+    }
+#endif
+
     if (phys_pc == -1) {
         /* Generate a temporary TB with 1 insn in it */
         cflags &= ~CF_COUNT_MASK;
@@ -1695,12 +1765,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  buffer_overflow:
     tb = tb_alloc(pc);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
-        mmap_unlock();
-        /* Make the execution loop process the flush as soon as possible.  */
-        cpu->exception_index = EXCP_INTERRUPT;
-        cpu_loop_exit(cpu);
+        return NULL;
     }
 
     gen_code_buf = tcg_ctx->code_gen_ptr;
@@ -1723,6 +1788,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tcg_ctx->cpu = ENV_GET_CPU(env);
     gen_intermediate_code(cpu, tb);
     tcg_ctx->cpu = NULL;
+    if (tcg_ctx->tb_host_ptr) {
+        tb->cflags |= CF_NOPERSIST;
+    }
 
     trace_translate_block(tb, tb->pc, tb->tc.ptr);
 
@@ -1838,9 +1906,95 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         return existing_tb;
     }
     tcg_tb_insert(tb);
+#ifdef CONFIG_USER_ONLY
+    if (tb_spec_enabled) {
+        tb_spec_enqueue(cpu, tb, spec_depth);
+    }
+#endif
     return tb;
 }
 
+/* Called with mmap_lock held for user mode emulation.  */
+TranslationBlock *tb_gen_code(CPUState *cpu,
+                              target_ulong pc, target_ulong cs_base,
+                              uint32_t flags, int cflags)
+{
+    TranslationBlock *tb = do_tb_gen_code(cpu, pc, cs_base, flags, cflags, 0);
+
+    if (unlikely(!tb)) {
+        /* eviction or flush must be done */
+        tb_evict(cpu);
+        mmap_unlock();
+        /* Make the execution loop process the flush as soon as possible.  */
+        cpu->exception_index = EXCP_INTERRUPT;
+        cpu_loop_exit(cpu);
+    }
+    return tb;
+}
+
+#ifdef CONFIG_USER_ONLY
+/*
+ * Translate a TB on behalf of @cpu from a thread other than its own.
+ * Unlike tb_gen_code(), a full code buffer is not handled here: NULL is
+ * returned and the flush is left to the next vCPU that needs space.
+ *
+ * Called with mmap_lock held.
+ */
+TranslationBlock *tb_gen_code_spec(CPUState *cpu,
+                                   target_ulong pc, target_ulong cs_base,
+                                   uint32_t flags, int cflags,
+                                   unsigned int spec_depth)
+{
+    assert_memory_lock();
+    return do_tb_gen_code(cpu, pc, cs_base, flags, cflags, spec_depth);
+}
+#endif
+
+#ifdef CONFIG_USER_ONLY
+/*
+ * Make @tb, whose code and descriptor were restored into code_gen_buffer
+ * from the persistent TB cache, reachable again.  Its outgoing jumps are
+ * reset, since they may point to TBs that are not valid in this process.
+ *
+ * Called with mmap_lock held.
+ */
+TranslationBlock *tb_link_cached(TranslationBlock *tb)
+{
+    TranslationBlock *existing_tb;
+    target_ulong virt_page2;
+    tb_page_addr_t phys_page2 = -1;
+
+    assert_memory_lock();
+
+    tb->cflags &= ~CF_INVALID;
+    tb->orig_tb = NULL;
+
+    qemu_spin_init(&tb->jmp_lock);
+    tb->jmp_list_head = (uintptr_t)NULL;
+    tb->jmp_list_next[0] = (uintptr_t)NULL;
+    tb->jmp_list_next[1] = (uintptr_t)NULL;
+    tb->jmp_dest[0] = (uintptr_t)NULL;
+    tb->jmp_dest[1] = (uintptr_t)NULL;
+    if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
+        tb_reset_jump(tb, 0);
+    }
+    if (tb->jmp_reset_offset[1] != TB_JMP_RESET_OFFSET_INVALID) {
+        tb_reset_jump(tb, 1);
+    }
+
+    virt_page2 = (tb->pc + tb->size - 1) & TARGET_PAGE_MASK;
+    if ((tb->pc & TARGET_PAGE_MASK) != virt_page2) {
+        phys_page2 = virt_page2;
+    }
+    existing_tb = tb_link_page(tb, tb->pc, phys_page2);
+    if (unlikely(existing_tb != tb)) {
+        return existing_tb;
+    }
+    tcg_tb_insert(tb);
+    return tb;
+}
+#endif
+
 /*
  * @p must be non-NULL.
  * user-mode: call with mmap_lock held.
@@ -2204,6 +2358,7 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
 
     for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
         atomic_set(&cpu->tb_jmp_cache[i0 + i], NULL);
+        atomic_set(&cpu->tb_jmp_cache2[i0 + i], NULL);
     }
 }
 
@@ -2291,6 +2446,8 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t jc_hit = 0, jc_hit2 = 0, jc_miss = 0, jc_total;
+    CPUState *cpu;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2325,8 +2482,21 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cpu_fprintf(f, "\nStatistics:\n");
     cpu_fprintf(f, "TB flush count      %u\n",
                 atomic_read(&tb_ctx.tb_flush_count));
+    cpu_fprintf(f, "TB evict count      %u\n",
+                atomic_read(&tb_ctx.tb_evict_count));
     cpu_fprintf(f, "TB invalidate count %zu\n", tcg_tb_phys_invalidate_count());
 
+    CPU_FOREACH(cpu) {
+        jc_hit += atomic_read(&cpu->tb_jmp_cache_hit);
+        jc_hit2 += atomic_read(&cpu->tb_jmp_cache_hit2);
+        jc_miss += atomic_read(&cpu->tb_jmp_cache_miss);
+    }
+    jc_total = jc_hit + jc_hit2 + jc_miss;
+    cpu_fprintf(f, "jump cache lookups  %zu (L1 hit %0.1f%%, L2 hit %0.1f%%, "
+                "miss %zu)\n", jc_total,
+                jc_total ? jc_hit * 100.0 / jc_total : 0,
+                jc_total ? jc_hit2 * 100.0 / jc_total : 0, jc_miss);
+
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     cpu_fprintf(f, "TLB full flushes    %zu\n", flush_full);
     cpu_fprintf(f, "TLB partial flushes %zu\n", flush_part);
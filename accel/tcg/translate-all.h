@@ -34,6 +34,21 @@ void tb_check_watchpoint(CPUState *cpu);
 
 #ifdef CONFIG_USER_ONLY
 int page_unprotect(target_ulong address, uintptr_t pc);
+TranslationBlock *tb_link_cached(TranslationBlock *tb);
+TranslationBlock *tb_gen_code_spec(CPUState *cpu,
+                                   target_ulong pc, target_ulong cs_base,
+                                   uint32_t flags, int cflags,
+                                   unsigned int spec_depth);
+
+/* tb-cache.c */
+TranslationBlock *tb_cache_adopt(target_ulong pc, target_ulong cs_base,
+                                 uint32_t flags, uint32_t cflags,
+                                 uint32_t trace_vcpu_dstate);
+void tb_cache_reset(void);
+
+/* tb-spec.c */
+extern bool tb_spec_enabled;
+void tb_spec_enqueue(CPUState *cpu, TranslationBlock *tb, unsigned int depth);
 #endif
 
 #endif /* TRANSLATE_ALL_H */
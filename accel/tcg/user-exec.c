@@ -577,6 +577,40 @@ int cpu_signal_handler(int host_signum, void *pinfo,
 
 #endif
 
+void *probe_access(CPUArchState *env, target_ulong addr, int size,
+                   MMUAccessType access_type, int mmu_idx, uintptr_t retaddr)
+{
+    int flags;
+
+    g_assert(-(addr | TARGET_PAGE_MASK) >= size);
+
+    switch (access_type) {
+    case MMU_DATA_LOAD:
+        flags = PAGE_READ;
+        break;
+    case MMU_DATA_STORE:
+        flags = PAGE_WRITE;
+        break;
+    case MMU_INST_FETCH:
+        flags = PAGE_EXEC;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    /* page_check_range also unprotects pages holding translated code */
+    if (!guest_addr_valid(addr) ||
+        page_check_range(addr, MAX(size, 1), flags) < 0) {
+        CPUState *cpu = ENV_GET_CPU(env);
+        CPUClass *cc = CPU_GET_CLASS(cpu);
+
+        g_assert(cc->handle_mmu_fault);
+        cc->handle_mmu_fault(cpu, addr, size, access_type, MMU_USER_IDX);
+        cpu_loop_exit_restore(cpu, retaddr);
+    }
+    return g2h(addr);
+}
+
 /* The softmmu versions of these helpers are in cputlb.c.  */
 
 /* Do not allow unaligned operations to proceed.  Return the host address.  */
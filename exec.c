@@ -926,6 +926,7 @@ void cpu_exec_unrealizefn(CPUState *cpu)
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_free_notifier_list(cpu);
 #endif
+    tlb_destroy(cpu);
 }
 
 Property cpu_common_props[] = {
@@ -1969,6 +1970,11 @@ const char *qemu_ram_get_idstr(RAMBlock *rb)
     return rb->idstr;
 }
 
+ram_addr_t qemu_ram_get_used_length(RAMBlock *rb)
+{
+    return rb->used_length;
+}
+
 bool qemu_ram_is_shared(RAMBlock *rb)
 {
     return rb->flags & RAM_SHARED;
@@ -3225,12 +3231,17 @@ static MemTxResult flatview_write_continue(FlatView *fv, hwaddr addr,
 
     for (;;) {
         if (!memory_access_is_direct(mr, true)) {
-            release_lock |= prepare_mmio_access(mr);
             l = memory_access_size(mr, l, addr1);
-            /* XXX: could force current_cpu to NULL to avoid
-               potential bugs */
             val = ldn_p(buf, l);
-            result |= memory_region_dispatch_write(mr, addr1, val, l, attrs);
+            /* Port I/O kicks such as legacy virtio need not take the BQL */
+            if (!memory_region_write_eventfd_lockless(mr, addr1, val, l,
+                                                      attrs)) {
+                release_lock |= prepare_mmio_access(mr);
+                /* XXX: could force current_cpu to NULL to avoid
+                   potential bugs */
+                result |= memory_region_dispatch_write(mr, addr1, val, l,
+                                                       attrs);
+            }
         } else {
             /* RAM case */
             ptr = qemu_ram_ptr_length(mr->ram_block, addr1, &l, false);
@@ -3448,53 +3459,48 @@ void cpu_flush_icache_range(hwaddr start, int len)
                                            start, NULL, len, FLUSH_CACHE);
 }
 
-typedef struct {
+struct BounceBuffer {
     MemoryRegion *mr;
     void *buffer;
     hwaddr addr;
     hwaddr len;
-    bool in_use;
-} BounceBuffer;
-
-static BounceBuffer bounce;
+    QLIST_ENTRY(BounceBuffer) link;
+};
 
-typedef struct MapClient {
+struct AddressSpaceMapClient {
     QEMUBH *bh;
-    QLIST_ENTRY(MapClient) link;
-} MapClient;
-
-QemuMutex map_client_list_lock;
-static QLIST_HEAD(map_client_list, MapClient) map_client_list
-    = QLIST_HEAD_INITIALIZER(map_client_list);
+    QLIST_ENTRY(AddressSpaceMapClient) link;
+};
 
-static void cpu_unregister_map_client_do(MapClient *client)
+static void
+address_space_unregister_map_client_do(AddressSpaceMapClient *client)
 {
     QLIST_REMOVE(client, link);
     g_free(client);
 }
 
-static void cpu_notify_map_clients_locked(void)
+static void address_space_notify_map_clients_locked(AddressSpace *as)
 {
-    MapClient *client;
+    AddressSpaceMapClient *client;
 
-    while (!QLIST_EMPTY(&map_client_list)) {
-        client = QLIST_FIRST(&map_client_list);
+    while (!QLIST_EMPTY(&as->map_client_list)) {
+        client = QLIST_FIRST(&as->map_client_list);
         qemu_bh_schedule(client->bh);
-        cpu_unregister_map_client_do(client);
+        address_space_unregister_map_client_do(client);
     }
 }
 
-void cpu_register_map_client(QEMUBH *bh)
+void address_space_register_map_client(AddressSpace *as, QEMUBH *bh)
 {
-    MapClient *client = g_malloc(sizeof(*client));
+    AddressSpaceMapClient *client = g_malloc(sizeof(*client));
 
-    qemu_mutex_lock(&map_client_list_lock);
+    qemu_mutex_lock(&as->bounce_lock);
     client->bh = bh;
-    QLIST_INSERT_HEAD(&map_client_list, client, link);
-    if (!atomic_read(&bounce.in_use)) {
-        cpu_notify_map_clients_locked();
+    QLIST_INSERT_HEAD(&as->map_client_list, client, link);
+    if (as->bounce_buffer_size == 0) {
+        address_space_notify_map_clients_locked(as);
     }
-    qemu_mutex_unlock(&map_client_list_lock);
+    qemu_mutex_unlock(&as->bounce_lock);
 }
 
 void cpu_exec_init_all(void)
@@ -3510,28 +3516,76 @@ void cpu_exec_init_all(void)
     finalize_target_page_bits();
     io_mem_init();
     memory_map_init();
-    qemu_mutex_init(&map_client_list_lock);
 }
 
-void cpu_unregister_map_client(QEMUBH *bh)
+void address_space_unregister_map_client(AddressSpace *as, QEMUBH *bh)
 {
-    MapClient *client;
+    AddressSpaceMapClient *client;
 
-    qemu_mutex_lock(&map_client_list_lock);
-    QLIST_FOREACH(client, &map_client_list, link) {
+    qemu_mutex_lock(&as->bounce_lock);
+    QLIST_FOREACH(client, &as->map_client_list, link) {
         if (client->bh == bh) {
-            cpu_unregister_map_client_do(client);
+            address_space_unregister_map_client_do(client);
+            break;
+        }
+    }
+    qemu_mutex_unlock(&as->bounce_lock);
+}
+
+/* Take up to @len bytes out of the bounce buffer budget of @as.  */
+static BounceBuffer *address_space_bounce_alloc(AddressSpace *as, hwaddr len)
+{
+    BounceBuffer *bounce;
+
+    qemu_mutex_lock(&as->bounce_lock);
+    if (as->bounce_buffer_size >= as->max_bounce_buffer_size) {
+        qemu_mutex_unlock(&as->bounce_lock);
+        return NULL;
+    }
+    len = MIN(len, as->max_bounce_buffer_size - as->bounce_buffer_size);
+    atomic_set(&as->bounce_buffer_size, as->bounce_buffer_size + len);
+    bounce = g_new0(BounceBuffer, 1);
+    bounce->buffer = qemu_memalign(TARGET_PAGE_SIZE, len);
+    bounce->len = len;
+    QLIST_INSERT_HEAD(&as->bounce_buffers, bounce, link);
+    qemu_mutex_unlock(&as->bounce_lock);
+
+    return bounce;
+}
+
+static BounceBuffer *address_space_bounce_find(AddressSpace *as, void *buffer)
+{
+    BounceBuffer *bounce;
+
+    /*
+     * Whoever unmaps a bounce buffer still holds its share of the budget,
+     * so there is nothing to look for while none is in use.
+     */
+    if (atomic_read(&as->bounce_buffer_size) == 0) {
+        return NULL;
+    }
+
+    qemu_mutex_lock(&as->bounce_lock);
+    QLIST_FOREACH(bounce, &as->bounce_buffers, link) {
+        if (bounce->buffer == buffer) {
             break;
         }
     }
-    qemu_mutex_unlock(&map_client_list_lock);
+    qemu_mutex_unlock(&as->bounce_lock);
+    return bounce;
 }
 
-static void cpu_notify_map_clients(void)
+static void address_space_bounce_free(AddressSpace *as, BounceBuffer *bounce)
 {
-    qemu_mutex_lock(&map_client_list_lock);
-    cpu_notify_map_clients_locked();
-    qemu_mutex_unlock(&map_client_list_lock);
+    memory_region_unref(bounce->mr);
+    qemu_vfree(bounce->buffer);
+
+    qemu_mutex_lock(&as->bounce_lock);
+    QLIST_REMOVE(bounce, link);
+    atomic_set(&as->bounce_buffer_size, as->bounce_buffer_size - bounce->len);
+    address_space_notify_map_clients_locked(as);
+    qemu_mutex_unlock(&as->bounce_lock);
+    g_free(bounce);
 }
 
 static bool flatview_access_valid(FlatView *fv, hwaddr addr, int len,
@@ -3601,8 +3655,8 @@ flatview_extend_translation(FlatView *fv, hwaddr addr,
  * May map a subset of the requested range, given by and returned in *plen.
  * May return NULL if resources needed to perform the mapping are exhausted.
  * Use only for reads OR writes - not for read-modify-write operations.
- * Use cpu_register_map_client() to know when retrying the map operation is
- * likely to succeed.
+ * Use address_space_register_map_client() to know when retrying the map
+ * operation is likely to succeed.
  */
 void *address_space_map(AddressSpace *as,
                         hwaddr addr,
@@ -3626,26 +3680,26 @@ void *address_space_map(AddressSpace *as,
     mr = flatview_translate(fv, addr, &xlat, &l, is_write, attrs);
 
     if (!memory_access_is_direct(mr, is_write)) {
-        if (atomic_xchg(&bounce.in_use, true)) {
+        /* The budget of @as also avoids unbounded allocations */
+        BounceBuffer *bounce = address_space_bounce_alloc(as, l);
+
+        if (!bounce) {
             rcu_read_unlock();
             return NULL;
         }
-        /* Avoid unbounded allocations */
-        l = MIN(l, TARGET_PAGE_SIZE);
-        bounce.buffer = qemu_memalign(TARGET_PAGE_SIZE, l);
-        bounce.addr = addr;
-        bounce.len = l;
+        l = bounce->len;
+        bounce->addr = addr;
 
         memory_region_ref(mr);
-        bounce.mr = mr;
+        bounce->mr = mr;
         if (!is_write) {
             flatview_read(fv, addr, MEMTXATTRS_UNSPECIFIED,
-                               bounce.buffer, l);
+                               bounce->buffer, l);
         }
 
         rcu_read_unlock();
         *plen = l;
-        return bounce.buffer;
+        return bounce->buffer;
     }
 
 
@@ -3665,7 +3719,9 @@ void *address_space_map(AddressSpace *as,
 void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
                          int is_write, hwaddr access_len)
 {
-    if (buffer != bounce.buffer) {
+    BounceBuffer *bounce = address_space_bounce_find(as, buffer);
+
+    if (!bounce) {
         MemoryRegion *mr;
         ram_addr_t addr1;
 
@@ -3681,14 +3737,10 @@ void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
         return;
     }
     if (is_write) {
-        address_space_write(as, bounce.addr, MEMTXATTRS_UNSPECIFIED,
-                            bounce.buffer, access_len);
-    }
-    qemu_vfree(bounce.buffer);
-    bounce.buffer = NULL;
-    memory_region_unref(bounce.mr);
-    atomic_mb_set(&bounce.in_use, false);
-    cpu_notify_map_clients();
+        address_space_write(as, bounce->addr, MEMTXATTRS_UNSPECIFIED,
+                            bounce->buffer, access_len);
+    }
+    address_space_bounce_free(as, bounce);
 }
 
 void *cpu_physical_memory_map(hwaddr addr,
@@ -264,7 +264,8 @@ ETEXI
 STEXI
 @item info mtree
 @findex info mtree
-Show memory tree.
+Show memory tree.  With @code{-f}, show the flat view of each address
+space, preceded by how often flat views were updated and re-rendered.
 ETEXI
 
 #if defined(CONFIG_TCG)
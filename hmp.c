@@ -236,6 +236,11 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->ram->page_size >> 10);
         monitor_printf(mon, "multifd bytes: %" PRIu64 " kbytes\n",
                        info->ram->multifd_bytes >> 10);
+        if (info->ram->flush_stalls) {
+            monitor_printf(mon, "flush stalls: %" PRIu64 " (%" PRIu64
+                           " us)\n", info->ram->flush_stalls,
+                           info->ram->flush_stall_time);
+        }
 
         if (info->ram->dirty_pages_rate) {
             monitor_printf(mon, "dirty pages rate: %" PRIu64 " pages\n",
@@ -396,6 +401,15 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %" PRIu64 "\n",
             MigrationParameter_str(MIGRATION_PARAMETER_MAX_POSTCOPY_BANDWIDTH),
             params->max_postcopy_bandwidth);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_POSTCOPY_PREFETCH_PAGES),
+            params->postcopy_prefetch_pages);
+        monitor_printf(mon, "%s: %" PRIu64 "\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_IO_BUFFER_SIZE),
+            params->io_buffer_size);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_BITMAP_SYNC_THREADS),
+            params->bitmap_sync_threads);
     }
 
     qapi_free_MigrationParameters(params);
@@ -1752,6 +1766,18 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_max_postcopy_bandwidth = true;
         visit_type_size(v, param, &p->max_postcopy_bandwidth, &err);
         break;
+    case MIGRATION_PARAMETER_POSTCOPY_PREFETCH_PAGES:
+        p->has_postcopy_prefetch_pages = true;
+        visit_type_int(v, param, &p->postcopy_prefetch_pages, &err);
+        break;
+    case MIGRATION_PARAMETER_IO_BUFFER_SIZE:
+        p->has_io_buffer_size = true;
+        visit_type_size(v, param, &p->io_buffer_size, &err);
+        break;
+    case MIGRATION_PARAMETER_BITMAP_SYNC_THREADS:
+        p->has_bitmap_sync_threads = true;
+        visit_type_int(v, param, &p->bitmap_sync_threads, &err);
+        break;
     default:
         assert(0);
     }
@@ -2594,6 +2620,7 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
     IOThreadInfoList *info_list = qmp_query_iothreads(NULL);
     IOThreadInfoList *info;
     IOThreadInfo *value;
+    IOThreadPollHandlerInfoList *handler;
 
     for (info = info_list; info; info = info->next) {
         value = info->value;
@@ -2602,6 +2629,15 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-max-ns=%" PRId64 "\n", value->poll_max_ns);
         monitor_printf(mon, "  poll-grow=%" PRId64 "\n", value->poll_grow);
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
+        monitor_printf(mon, "  poll-budget=%" PRId64 "\n", value->poll_budget);
+        for (handler = value->poll_handlers; handler; handler = handler->next) {
+            IOThreadPollHandlerInfo *h = handler->value;
+
+            monitor_printf(mon, "  fd %" PRId64 ": hits=%" PRId64
+                           " misses=%" PRId64 " avg-hit-ns=%" PRId64 "%s\n",
+                           h->fd, h->hits, h->misses, h->avg_hit_ns,
+                           h->idle ? " (idle)" : "");
+        }
     }
 
     qapi_free_IOThreadInfoList(info_list);
@@ -41,25 +41,53 @@ static void virtio_blk_init_request(VirtIOBlock *s, VirtQueue *vq,
 
 static void virtio_blk_free_request(VirtIOBlockReq *req)
 {
-    g_free(req);
+    virtqueue_element_free(req->vq, req);
 }
 
-static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
+/*
+ * Complete up to VIRTIO_BLK_MAX_MERGE_REQS requests with the same status.
+ * Consecutive requests from the same virtqueue are returned to the guest
+ * together, with a single notification.
+ */
+static void virtio_blk_req_complete_batch(VirtIOBlockReq **reqs,
+                                          unsigned int num,
+                                          unsigned char status)
 {
-    VirtIOBlock *s = req->dev;
+    VirtIOBlock *s = reqs[0]->dev;
     VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    VirtQueueElement *elems[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int lens[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int i, start = 0;
 
-    trace_virtio_blk_req_complete(vdev, req, status);
+    assert(num <= VIRTIO_BLK_MAX_MERGE_REQS);
+    for (i = 0; i < num; i++) {
+        VirtIOBlockReq *req = reqs[i];
 
-    stb_p(&req->in->status, status);
-    virtqueue_push(req->vq, &req->elem, req->in_len);
-    if (s->dataplane_started && !s->dataplane_disabled) {
-        virtio_blk_data_plane_notify(s->dataplane, req->vq);
-    } else {
-        virtio_notify(vdev, req->vq);
+        trace_virtio_blk_req_complete(vdev, req, status);
+
+        stb_p(&req->in->status, status);
+        elems[i] = &req->elem;
+        lens[i] = req->in_len;
+        if (i + 1 < num && reqs[i + 1]->vq == req->vq) {
+            continue;
+        }
+
+        virtqueue_push_batch(req->vq, elems + start, lens + start,
+                             i + 1 - start);
+        if (s->dataplane_started && !s->dataplane_disabled) {
+            virtio_blk_data_plane_notify(s->dataplane, req->vq);
+        } else {
+            virtio_notify(vdev, req->vq);
+        }
+        start = i + 1;
     }
 }
 
+static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
+{
+    virtio_blk_req_complete_batch(&req, 1, status);
+}
+
 static int virtio_blk_handle_rw_error(VirtIOBlockReq *req, int error,
     bool is_read)
 {
@@ -88,6 +116,8 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
     VirtIOBlockReq *next = opaque;
     VirtIOBlock *s = next->dev;
     VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    VirtIOBlockReq *done[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int i, num_done = 0;
 
     aio_context_acquire(blk_get_aio_context(s->conf.conf.blk));
     while (next) {
@@ -118,9 +148,16 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
             }
         }
 
-        virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
-        block_acct_done(blk_get_stats(req->dev->blk), &req->acct);
-        virtio_blk_free_request(req);
+        /* A merged request is made of at most VIRTIO_BLK_MAX_MERGE_REQS */
+        done[num_done++] = req;
+    }
+
+    if (num_done) {
+        virtio_blk_req_complete_batch(done, num_done, VIRTIO_BLK_S_OK);
+    }
+    for (i = 0; i < num_done; i++) {
+        block_acct_done(blk_get_stats(s->blk), &done[i]->acct);
+        virtio_blk_free_request(done[i]);
     }
     aio_context_release(blk_get_aio_context(s->conf.conf.blk));
 }
@@ -198,14 +235,18 @@ out:
 
 #endif
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
+static unsigned int virtio_blk_get_requests(VirtIOBlock *s, VirtQueue *vq,
+                                            VirtIOBlockReq **reqs,
+                                            unsigned int max)
 {
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
+    unsigned int i, num_reqs;
 
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
+    num_reqs = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq),
+                                   (void **)reqs, max);
+    for (i = 0; i < num_reqs; i++) {
+        virtio_blk_init_request(s, vq, reqs[i]);
     }
-    return req;
+    return num_reqs;
 }
 
 static int virtio_blk_handle_scsi_req(VirtIOBlockReq *req)
@@ -593,7 +634,8 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 
 bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
+    VirtIOBlockReq *reqs[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int i, num_reqs;
     MultiReqBuffer mrb = {};
     bool progress = false;
 
@@ -603,11 +645,20 @@ bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
     do {
         virtio_queue_set_notification(vq, 0);
 
-        while ((req = virtio_blk_get_request(s, vq))) {
+        while ((num_reqs = virtio_blk_get_requests(s, vq, reqs,
+                                                   ARRAY_SIZE(reqs)))) {
             progress = true;
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                virtio_blk_free_request(req);
+            for (i = 0; i < num_reqs; i++) {
+                if (virtio_blk_handle_request(reqs[i], &mrb)) {
+                    break;
+                }
+            }
+            if (i < num_reqs) {
+                /* The device is now broken, drop what is left of the batch */
+                for (; i < num_reqs; i++) {
+                    virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                    virtio_blk_free_request(reqs[i]);
+                }
                 break;
             }
         }
@@ -861,7 +912,7 @@ static void virtio_blk_save_device(VirtIODevice *vdev, QEMUFile *f)
             qemu_put_be32(f, virtio_get_queue_index(req->vq));
         }
 
-        qemu_put_virtqueue_element(f, &req->elem);
+        qemu_put_virtqueue_element(vdev, f, &req->elem);
         req = req->next;
     }
     qemu_put_sbyte(f, 0);
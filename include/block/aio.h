@@ -139,6 +139,11 @@ struct AioContext {
     int64_t poll_max_ns;    /* maximum polling time in nanoseconds */
     int64_t poll_grow;      /* polling time growth factor */
     int64_t poll_shrink;    /* polling time shrink factor */
+    int64_t poll_budget;    /* max % of CPU time spent polling, 0 = no cap */
+    int64_t poll_budget_start;   /* start of the current budget period */
+    int64_t poll_budget_used_ns; /* time spent polling in this period */
+    unsigned int poll_idle_check; /* polling windows since idle handlers
+                                     were last polled */
 
     /* Are we in polling mode or monitoring file descriptors? */
     bool poll_started;
@@ -147,6 +152,10 @@ struct AioContext {
     int epollfd;
     bool epoll_enabled;
     bool epoll_available;
+
+    /* Whether the GSource polls epoll_pfd instead of each handler's fd */
+    bool epoll_source;
+    GPollFD epoll_pfd;
 };
 
 /**
@@ -623,4 +632,39 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
                                  int64_t grow, int64_t shrink,
                                  Error **errp);
 
+/**
+ * aio_context_set_poll_budget:
+ * @ctx: the aio context
+ * @budget: percentage of CPU time that busy polling may use, or 0 for no
+ *          limit
+ *
+ * Once busy polling has used up its budget, the AioContext stops busy
+ * polling for the rest of the budget period and only waits for events in
+ * ppoll(2)/epoll_wait(2).
+ */
+void aio_context_set_poll_budget(AioContext *ctx, int64_t budget,
+                                 Error **errp);
+
+typedef struct AioPollHandlerStats {
+    int fd;
+    bool idle;                  /* left out of busy polling */
+    unsigned long hits;         /* polling windows ended by this handler */
+    unsigned long misses;       /* polling windows it did not end */
+    unsigned int avg_hit_ns;    /* average time from window start to a hit */
+} AioPollHandlerStats;
+
+/**
+ * aio_context_get_poll_stats:
+ * @ctx: the aio context
+ * @count: set to the number of elements in the returned array
+ *
+ * Get the busy polling statistics of each handler with an io_poll
+ * callback.  May be called from any thread; the values are not a
+ * consistent snapshot.
+ *
+ * Returns: an array of statistics, to be freed with g_free()
+ */
+AioPollHandlerStats *aio_context_get_poll_stats(AioContext *ctx,
+                                                unsigned int *count);
+
 #endif
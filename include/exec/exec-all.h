@@ -104,6 +104,11 @@ void cpu_address_space_init(CPUState *cpu, int asidx,
  * @cpu: CPU whose TLB should be initialized
  */
 void tlb_init(CPUState *cpu);
+/**
+ * tlb_destroy - free a CPU's TLB
+ * @cpu: CPU whose TLB should be freed
+ */
+void tlb_destroy(CPUState *cpu);
 /**
  * tlb_flush_page:
  * @cpu: CPU whose TLB should be flushed
@@ -266,6 +271,9 @@ void probe_write(CPUArchState *env, target_ulong addr, int size, int mmu_idx,
 static inline void tlb_init(CPUState *cpu)
 {
 }
+static inline void tlb_destroy(CPUState *cpu)
+{
+}
 static inline void tlb_flush_page(CPUState *cpu, target_ulong addr)
 {
 }
@@ -313,6 +321,28 @@ static inline void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *cpu,
 }
 #endif
 
+/**
+ * probe_access:
+ * @env: CPUArchState
+ * @addr: guest virtual address of the first byte
+ * @size: number of bytes, which must all be on the page of @addr
+ * @access_type: type of access to check for
+ * @mmu_idx: MMU index to use for the lookup
+ * @retaddr: return address for unwinding if the access faults
+ *
+ * Check that @size bytes at @addr may be accessed as @access_type,
+ * filling the TLB if needed and raising the guest exception if not.
+ * Return the host address of @addr when the whole range may then be
+ * accessed directly, or NULL when each access must still go through the
+ * cpu_ld/st functions (I/O memory, watchpoints, writes that need dirty
+ * tracking or the invalidation of translated code).
+ *
+ * This lets helpers that operate on blocks of guest memory do a single
+ * check per page instead of one per element.
+ */
+void *probe_access(CPUArchState *env, target_ulong addr, int size,
+                   MMUAccessType access_type, int mmu_idx, uintptr_t retaddr);
+
 #define CODE_GEN_ALIGN           16 /* must be >= of the size of a icache line */
 
 /* Estimated block size for TB allocation.  */
@@ -351,6 +381,7 @@ struct TranslationBlock {
 #define CF_USE_ICOUNT  0x00020000
 #define CF_INVALID     0x00040000 /* TB is stale. Set with @jmp_lock held */
 #define CF_PARALLEL    0x00080000 /* Generate code for a parallel context */
+#define CF_NOPERSIST   0x00200000 /* Code is only valid in this process */
 /* cflags' mask for hashing/comparison */
 #define CF_HASH_MASK   \
     (CF_COUNT_MASK | CF_LAST_IO | CF_USE_ICOUNT | CF_PARALLEL)
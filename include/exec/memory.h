@@ -385,6 +385,12 @@ struct MemoryRegion {
     const char *name;
     unsigned ioeventfd_nb;
     MemoryRegionIoeventfd *ioeventfds;
+    /* Copy of ioeventfds for memory_region_write_eventfd_lockless() */
+    struct MemoryRegionIoeventfdTable *ioeventfd_table;
+    /* Change tracking for FlatView updates, see flatviews_reset() */
+    unsigned topology_gen;
+    unsigned topology_scan_gen;
+    bool topology_scan_changed;
 };
 
 struct IOMMUMemoryRegion {
@@ -431,6 +437,9 @@ struct MemoryListener {
     QTAILQ_ENTRY(MemoryListener) link_as;
 };
 
+/* Default budget for the bounce buffers of an address space.  */
+#define DEFAULT_MAX_BOUNCE_BUFFER_SIZE (4096)
+
 /**
  * AddressSpace: describes a mapping of addresses to #MemoryRegion objects
  */
@@ -447,10 +456,19 @@ struct AddressSpace {
     struct MemoryRegionIoeventfd *ioeventfds;
     QTAILQ_HEAD(memory_listeners_as, MemoryListener) listeners;
     QTAILQ_ENTRY(AddressSpace) address_spaces_link;
+
+    /* Bounce buffers handed out by address_space_map(), see exec.c.  */
+    QemuMutex bounce_lock;
+    size_t bounce_buffer_size;
+    size_t max_bounce_buffer_size;
+    QLIST_HEAD(, BounceBuffer) bounce_buffers;
+    QLIST_HEAD(, AddressSpaceMapClient) map_client_list;
 };
 
 typedef struct AddressSpaceDispatch AddressSpaceDispatch;
 typedef struct FlatRange FlatRange;
+typedef struct BounceBuffer BounceBuffer;
+typedef struct AddressSpaceMapClient AddressSpaceMapClient;
 
 /* Flattened global view of current active memory hierarchy.  Kept in sorted
  * order.
@@ -1720,6 +1738,29 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
                                         uint64_t *pval,
                                         unsigned size,
                                         MemTxAttrs attrs);
+/**
+ * memory_region_write_eventfd_lockless: signal the ioeventfd that a write
+ * to the specified MemoryRegion would signal, without taking the global lock.
+ *
+ * This lets a vCPU kick a device whose host notifiers are serviced by
+ * another thread without serializing on the global lock.  Returns false,
+ * having done nothing, if no ioeventfd of @mr matches the write; the
+ * caller must then perform it with memory_region_dispatch_write().
+ *
+ * Must be called within an RCU critical section.
+ *
+ * @mr: #MemoryRegion to access
+ * @addr: address within that region
+ * @data: data to write
+ * @size: size of the access in bytes
+ * @attrs: memory transaction attributes to use for the access
+ */
+bool memory_region_write_eventfd_lockless(MemoryRegion *mr,
+                                          hwaddr addr,
+                                          uint64_t data,
+                                          unsigned size,
+                                          MemTxAttrs attrs);
+
 /**
  * memory_region_dispatch_write: perform a write directly to the specified
  * MemoryRegion.
@@ -1999,8 +2040,11 @@ bool address_space_access_valid(AddressSpace *as, hwaddr addr, int len,
  * May map a subset of the requested range, given by and returned in @plen.
  * May return %NULL if resources needed to perform the mapping are exhausted.
  * Use only for reads OR writes - not for read-modify-write operations.
- * Use cpu_register_map_client() to know when retrying the map operation is
- * likely to succeed.
+ * Use address_space_register_map_client() to know when retrying the map
+ * operation is likely to succeed.
+ *
+ * Accesses that cannot be mapped directly go through bounce buffers,
+ * which are limited to @as's max_bounce_buffer_size bytes in total.
  *
  * @as: #AddressSpace to be accessed
  * @addr: address within that address space
@@ -2025,6 +2069,25 @@ void *address_space_map(AddressSpace *as, hwaddr addr,
 void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
                          int is_write, hwaddr access_len);
 
+/* address_space_register_map_client: ask to be notified when a failed
+ * address_space_map() on @as is worth retrying
+ *
+ * @bh is scheduled, and then forgotten, once bounce buffer space is
+ * released.  It is scheduled immediately if no bounce buffer is in use.
+ *
+ * @as: #AddressSpace whose address_space_map() failed
+ * @bh: bottom half to schedule
+ */
+void address_space_register_map_client(AddressSpace *as, QEMUBH *bh);
+
+/* address_space_unregister_map_client: cancel
+ * address_space_register_map_client()
+ *
+ * @as: #AddressSpace that @bh was registered with
+ * @bh: bottom half to forget
+ */
+void address_space_unregister_map_client(AddressSpace *as, QEMUBH *bh);
+
 
 /* Internal functions, part of the implementation of address_space_read.  */
 MemTxResult address_space_read_full(AddressSpace *as, hwaddr addr,
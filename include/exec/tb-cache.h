@@ -0,0 +1,30 @@
+/*
+ * Persistent translation block cache for user-mode emulation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef EXEC_TB_CACHE_H
+#define EXEC_TB_CACHE_H
+
+/*
+ * tb_cache_load:
+ * @dir: directory holding the cache files
+ * @exec_path: path of the guest executable
+ *
+ * Restore the translations saved by a previous run of @exec_path, if
+ * any, and arrange for tb_cache_save() to write them back.  Must be
+ * called once the prologue is generated and before any translation.
+ */
+void tb_cache_load(const char *dir, const char *exec_path);
+
+/*
+ * tb_cache_save:
+ *
+ * Write the current translations to the cache file selected by
+ * tb_cache_load().  Does nothing if the cache is not in use.
+ */
+void tb_cache_save(void);
+
+#endif
@@ -22,6 +22,20 @@
 
 #include "exec/tb-hash-xx.h"
 
+/* Low PC bits that are always zero for the guest's instructions.  Leaving
+   them out of the jump cache index avoids wasting most of the slots on
+   targets with fixed-size instructions.  */
+#if defined(TARGET_I386) || defined(TARGET_XTENSA)
+# define TB_JMP_PC_SHIFT 0
+#elif defined(TARGET_PPC) || defined(TARGET_SPARC) || defined(TARGET_ALPHA) \
+    || defined(TARGET_HPPA) || defined(TARGET_OPENRISC) \
+    || defined(TARGET_NIOS2) || defined(TARGET_MICROBLAZE) \
+    || defined(TARGET_LM32) || defined(TARGET_UNICORE32)
+# define TB_JMP_PC_SHIFT 2
+#else
+# define TB_JMP_PC_SHIFT 1
+#endif
+
 #ifdef CONFIG_SOFTMMU
 
 /* Only the bottom TB_JMP_PAGE_BITS of the jump cache hash bits vary for
@@ -44,7 +58,9 @@ static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
     target_ulong tmp;
     tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
     return (((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK)
-           | (tmp & TB_JMP_ADDR_MASK));
+           | (((pc >> TB_JMP_PC_SHIFT)
+               ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)))
+              & TB_JMP_ADDR_MASK));
 }
 
 #else
@@ -52,7 +68,8 @@ static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
 /* In user-mode we can get better hashing because we do not have a TLB */
 static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
 {
-    return (pc ^ (pc >> TB_JMP_CACHE_BITS)) & (TB_JMP_CACHE_SIZE - 1);
+    return ((pc >> TB_JMP_PC_SHIFT) ^ (pc >> TB_JMP_CACHE_BITS))
+           & (TB_JMP_CACHE_SIZE - 1);
 }
 
 #endif /* CONFIG_SOFTMMU */
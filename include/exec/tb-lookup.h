@@ -16,6 +16,44 @@
 #include "exec/exec-all.h"
 #include "exec/tb-hash.h"
 
+static inline bool tb_jmp_cache_match(CPUState *cpu,
+                                      const TranslationBlock *tb,
+                                      target_ulong pc, target_ulong cs_base,
+                                      uint32_t flags, uint32_t cf_mask)
+{
+    return tb &&
+           tb->pc == pc &&
+           tb->cs_base == cs_base &&
+           tb->flags == flags &&
+           tb->trace_vcpu_dstate == *cpu->trace_dstate &&
+           (tb_cflags(tb) & (CF_HASH_MASK | CF_INVALID)) == cf_mask;
+}
+
+static inline void tb_jmp_cache_stat_inc(size_t *counter)
+{
+    atomic_set(counter, *counter + 1);
+}
+
+/*
+ * Insert @tb in the first level of the jump cache, demoting the previous
+ * occupant of the slot to the second level.  Invalidated TBs that end up
+ * in the second level are harmless: tb_jmp_cache_match() rejects them,
+ * and whatever reuses TB memory must clear both levels of every vCPU
+ * first, as tb_flush() does.
+ */
+static inline void tb_jmp_cache_insert(CPUState *cpu, uint32_t hash,
+                                       TranslationBlock *tb)
+{
+    TranslationBlock *old = atomic_read(&cpu->tb_jmp_cache[hash]);
+
+    if (old != tb) {
+        if (old) {
+            atomic_set(&cpu->tb_jmp_cache2[hash], old);
+        }
+        atomic_set(&cpu->tb_jmp_cache[hash], tb);
+    }
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *
 tb_lookup__cpu_state(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
@@ -28,19 +66,24 @@ tb_lookup__cpu_state(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
     cpu_get_tb_cpu_state(env, pc, cs_base, flags);
     hash = tb_jmp_cache_hash_func(*pc);
     tb = atomic_rcu_read(&cpu->tb_jmp_cache[hash]);
-    if (likely(tb &&
-               tb->pc == *pc &&
-               tb->cs_base == *cs_base &&
-               tb->flags == *flags &&
-               tb->trace_vcpu_dstate == *cpu->trace_dstate &&
-               (tb_cflags(tb) & (CF_HASH_MASK | CF_INVALID)) == cf_mask)) {
+    if (likely(tb_jmp_cache_match(cpu, tb, *pc, *cs_base, *flags, cf_mask))) {
+        tb_jmp_cache_stat_inc(&cpu->tb_jmp_cache_hit);
+        return tb;
+    }
+    tb = atomic_rcu_read(&cpu->tb_jmp_cache2[hash]);
+    if (tb_jmp_cache_match(cpu, tb, *pc, *cs_base, *flags, cf_mask)) {
+        tb_jmp_cache_stat_inc(&cpu->tb_jmp_cache_hit2);
+        /* Swap the two levels so that alternating targets, as found in
+           interpreter dispatch loops, keep hitting.  */
+        tb_jmp_cache_insert(cpu, hash, tb);
         return tb;
     }
+    tb_jmp_cache_stat_inc(&cpu->tb_jmp_cache_miss);
     tb = tb_htable_lookup(cpu, *pc, *cs_base, *flags, cf_mask);
     if (tb == NULL) {
         return NULL;
     }
-    atomic_set(&cpu->tb_jmp_cache[hash], tb);
+    tb_jmp_cache_insert(cpu, hash, tb);
     return tb;
 }
 
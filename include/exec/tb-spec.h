@@ -0,0 +1,31 @@
+/*
+ * Speculative translation of successor blocks for user-mode emulation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef EXEC_TB_SPEC_H
+#define EXEC_TB_SPEC_H
+
+/*
+ * tb_spec_init:
+ *
+ * Start the thread that translates the successors of newly translated
+ * blocks in the background.  Must be called once the TCG regions are
+ * set up and before any vCPU runs.
+ */
+void tb_spec_init(void);
+
+/*
+ * tb_spec_fork_start:
+ * tb_spec_fork_end:
+ * @child: true in the child process
+ *
+ * Keep the request queue consistent across fork(); the child gets a
+ * new worker thread.  To be called with mmap_lock held.
+ */
+void tb_spec_fork_start(void);
+void tb_spec_fork_end(int child);
+
+#endif
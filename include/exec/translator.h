@@ -141,4 +141,20 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
 void translator_loop_temp_check(DisasContextBase *db);
 
+/**
+ * translator_note_goto_tb:
+ * @n: Jump slot, as passed to tcg_gen_goto_tb().
+ * @dest: Guest address the direct jump leads to.
+ *
+ * Record the destination of a direct jump out of the TB being translated,
+ * whether or not it ends up being chained.  This does not change the
+ * generated code; user-mode emulation uses it to translate successors
+ * ahead of time.
+ */
+static inline void translator_note_goto_tb(int n, target_ulong dest)
+{
+    tcg_ctx->goto_tb_dest[n] = dest;
+    tcg_ctx->goto_tb_dest_mask |= 1 << n;
+}
+
 #endif  /* EXEC__TRANSLATOR_H */
@@ -65,6 +65,21 @@ typedef void coroutine_fn CoroutineEntry(void *opaque);
  */
 Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque);
 
+typedef struct CoroutinePoolStats {
+    unsigned long pool_hits;    /* creations served from a pool */
+    unsigned long allocations;  /* creations that allocated a stack */
+    unsigned long frees;        /* coroutines whose stack was freed */
+    size_t max_stack_usage;     /* in bytes, as sampled so far */
+    size_t stack_size;          /* in bytes, of every coroutine */
+} CoroutinePoolStats;
+
+/**
+ * Get statistics about coroutine creation and the coroutine pools
+ *
+ * Pool hits of other threads may be reported with a little delay.
+ */
+void qemu_coroutine_get_pool_stats(CoroutinePoolStats *stats);
+
 /**
  * Transfer control to a coroutine
  */
@@ -66,6 +66,8 @@ struct Coroutine {
 
 Coroutine *qemu_coroutine_new(void);
 void qemu_coroutine_delete(Coroutine *co);
+/* How much of the stack of @co has been used, or 0 if unknown */
+size_t qemu_coroutine_stack_usage(Coroutine *co);
 CoroutineAction qemu_coroutine_switch(Coroutine *from, Coroutine *to,
                                       CoroutineAction action);
 
@@ -366,8 +366,17 @@ struct CPUState {
 
     void *env_ptr; /* CPUArchState */
 
-    /* Accessed in parallel; all accesses must be atomic */
+    /* Accessed in parallel; all accesses must be atomic.
+     * tb_jmp_cache2 is a victim level indexed like tb_jmp_cache: it holds
+     * the TB last evicted from each slot of the first level.
+     */
     struct TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    struct TranslationBlock *tb_jmp_cache2[TB_JMP_CACHE_SIZE];
+
+    /* Jump cache statistics; only written by the vCPU thread */
+    size_t tb_jmp_cache_hit;
+    size_t tb_jmp_cache_hit2;
+    size_t tb_jmp_cache_miss;
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -451,6 +460,7 @@ static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
 
     for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
         atomic_set(&cpu->tb_jmp_cache[i], NULL);
+        atomic_set(&cpu->tb_jmp_cache2[i], NULL);
     }
 }
 
@@ -80,6 +80,17 @@ void *qemu_alloc_stack(size_t *sz);
  */
 void qemu_free_stack(void *stack, size_t sz);
 
+/**
+ * qemu_stack_usage:
+ * @stack: stack allocated via qemu_alloc_stack()
+ * @sz: size of stack in bytes, as for qemu_free_stack()
+ *
+ * Returns: how many bytes of the stack are backed by memory, which is
+ * an upper bound on its peak usage so far, or 0 if this cannot be
+ * determined on this host.
+ */
+size_t qemu_stack_usage(void *stack, size_t sz);
+
 /* POSIX and Mingw32 differ in the name of the stdio lock functions.  */
 
 static inline void qemu_flockfile(FILE *f)
@@ -162,6 +162,10 @@ static void iothread_complete(UserCreatable *obj, Error **errp)
                                 iothread->poll_grow,
                                 iothread->poll_shrink,
                                 &local_error);
+    if (!local_error) {
+        aio_context_set_poll_budget(iothread->ctx, iothread->poll_budget,
+                                    &local_error);
+    }
     if (local_error) {
         error_propagate(errp, local_error);
         aio_context_unref(iothread->ctx);
@@ -195,16 +199,20 @@ static void iothread_complete(UserCreatable *obj, Error **errp)
 typedef struct {
     const char *name;
     ptrdiff_t offset; /* field's byte offset in IOThread struct */
+    int64_t max;      /* largest valid value */
 } PollParamInfo;
 
 static PollParamInfo poll_max_ns_info = {
-    "poll-max-ns", offsetof(IOThread, poll_max_ns),
+    "poll-max-ns", offsetof(IOThread, poll_max_ns), INT64_MAX,
 };
 static PollParamInfo poll_grow_info = {
-    "poll-grow", offsetof(IOThread, poll_grow),
+    "poll-grow", offsetof(IOThread, poll_grow), INT64_MAX,
 };
 static PollParamInfo poll_shrink_info = {
-    "poll-shrink", offsetof(IOThread, poll_shrink),
+    "poll-shrink", offsetof(IOThread, poll_shrink), INT64_MAX,
+};
+static PollParamInfo poll_budget_info = {
+    "poll-budget", offsetof(IOThread, poll_budget), 100,
 };
 
 static void iothread_get_poll_param(Object *obj, Visitor *v,
@@ -231,9 +239,9 @@ static void iothread_set_poll_param(Object *obj, Visitor *v,
         goto out;
     }
 
-    if (value < 0) {
+    if (value < 0 || value > info->max) {
         error_setg(&local_err, "%s value must be in range [0, %"PRId64"]",
-                   info->name, INT64_MAX);
+                   info->name, info->max);
         goto out;
     }
 
@@ -245,6 +253,10 @@ static void iothread_set_poll_param(Object *obj, Visitor *v,
                                     iothread->poll_grow,
                                     iothread->poll_shrink,
                                     &local_err);
+        if (!local_err) {
+            aio_context_set_poll_budget(iothread->ctx, iothread->poll_budget,
+                                        &local_err);
+        }
     }
 
 out:
@@ -268,6 +280,10 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_poll_param,
                               iothread_set_poll_param,
                               NULL, &poll_shrink_info, &error_abort);
+    object_class_property_add(klass, "poll-budget", "int",
+                              iothread_get_poll_param,
+                              iothread_set_poll_param,
+                              NULL, &poll_budget_info, &error_abort);
 }
 
 static const TypeInfo iothread_info = {
@@ -300,6 +316,35 @@ AioContext *iothread_get_aio_context(IOThread *iothread)
     return iothread->ctx;
 }
 
+static IOThreadPollHandlerInfoList *query_poll_handlers(IOThread *iothread)
+{
+    IOThreadPollHandlerInfoList *head = NULL, **prev = &head;
+    AioPollHandlerStats *stats;
+    unsigned int i, count;
+
+    if (!iothread->ctx) {
+        return NULL;
+    }
+    stats = aio_context_get_poll_stats(iothread->ctx, &count);
+    for (i = 0; i < count; i++) {
+        IOThreadPollHandlerInfoList *elem;
+        IOThreadPollHandlerInfo *info = g_new0(IOThreadPollHandlerInfo, 1);
+
+        info->fd = stats[i].fd;
+        info->idle = stats[i].idle;
+        info->hits = stats[i].hits;
+        info->misses = stats[i].misses;
+        info->avg_hit_ns = stats[i].avg_hit_ns;
+
+        elem = g_new0(IOThreadPollHandlerInfoList, 1);
+        elem->value = info;
+        *prev = elem;
+        prev = &elem->next;
+    }
+    g_free(stats);
+    return head;
+}
+
 static int query_one_iothread(Object *object, void *opaque)
 {
     IOThreadInfoList ***prev = opaque;
@@ -318,6 +363,8 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_max_ns = iothread->poll_max_ns;
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
+    info->poll_budget = iothread->poll_budget;
+    info->poll_handlers = query_poll_handlers(iothread);
 
     elem = g_new0(IOThreadInfoList, 1);
     elem->value = info;
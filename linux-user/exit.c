@@ -18,6 +18,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu.h"
+#include "exec/tb-cache.h"
 
 #ifdef CONFIG_GCOV
 extern void __gcov_dump(void);
@@ -32,4 +33,5 @@ void preexit_cleanup(CPUArchState *env, int code)
         __gcov_dump();
 #endif
         gdb_exit(env, code);
+        tb_cache_save();
 }
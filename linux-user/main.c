@@ -30,6 +30,8 @@
 #include "qemu/help_option.h"
 #include "cpu.h"
 #include "exec/exec-all.h"
+#include "exec/tb-cache.h"
+#include "exec/tb-spec.h"
 #include "tcg.h"
 #include "qemu/timer.h"
 #include "qemu/envlist.h"
@@ -114,11 +116,13 @@ void fork_start(void)
 {
     start_exclusive();
     mmap_fork_start();
+    tb_spec_fork_start();
     cpu_list_lock();
 }
 
 void fork_end(int child)
 {
+    tb_spec_fork_end(child);
     mmap_fork_end(child);
     if (child) {
         CPUState *cpu, *next_cpu;
@@ -300,6 +304,20 @@ static void handle_arg_randseed(const char *arg)
     srand(seed);
 }
 
+static const char *tb_cache_dir;
+
+static void handle_arg_tb_cache(const char *arg)
+{
+    tb_cache_dir = arg;
+}
+
+static bool tb_spec;
+
+static void handle_arg_tb_spec(const char *arg)
+{
+    tb_spec = true;
+}
+
 static void handle_arg_gdb(const char *arg)
 {
     gdbstub_port = atoi(arg);
@@ -430,6 +448,10 @@ static const struct qemu_argument arg_table[] = {
      "pagesize",   "set the host page size to 'pagesize'"},
     {"singlestep", "QEMU_SINGLESTEP",  false, handle_arg_singlestep,
      "",           "run in singlestep mode"},
+    {"tb-cache",   "QEMU_TB_CACHE",    true,  handle_arg_tb_cache,
+     "dir",        "keep translated code across runs in 'dir'"},
+    {"tb-spec",    "QEMU_TB_SPEC",     false, handle_arg_tb_spec,
+     "",           "translate jump targets ahead of time in a thread"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_randseed,
@@ -806,6 +828,14 @@ int main(int argc, char **argv, char **envp)
     tcg_prologue_init(tcg_ctx);
     tcg_region_init();
 
+    if (tb_cache_dir) {
+        tb_cache_load(tb_cache_dir, filename);
+    }
+    /* The worker would race with breakpoint insertion by the gdbstub */
+    if (tb_spec && !gdbstub_port) {
+        tb_spec_init();
+    }
+
     target_cpu_copy_regs(env, regs);
 
     if (gdbstub_port) {
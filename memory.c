@@ -21,7 +21,9 @@
 #include "exec/address-spaces.h"
 #include "qapi/visitor.h"
 #include "qemu/bitops.h"
+#include "qemu/processor.h"
 #include "qemu/error-report.h"
+#include "qemu/timer.h"
 #include "qom/object.h"
 #include "trace-root.h"
 
@@ -36,6 +38,7 @@
 
 static unsigned memory_region_transaction_depth;
 static bool memory_region_update_pending;
+static bool memory_region_update_all;
 static bool ioeventfd_update_pending;
 static bool global_dirty_log = false;
 
@@ -47,6 +50,20 @@ static QTAILQ_HEAD(, AddressSpace) address_spaces
 
 static GHashTable *flat_views;
 
+/*
+ * Regions whose rendering changed since the last topology update carry
+ * the current generation in ->topology_gen; only the FlatViews whose
+ * root reaches one of them are rendered again.
+ */
+static unsigned memory_topology_gen = 1;
+
+static struct {
+    uint64_t updates;
+    uint64_t rendered;
+    uint64_t reused;
+    int64_t render_ns;
+} flatview_stats;
+
 typedef struct AddrRange AddrRange;
 
 /*
@@ -171,6 +188,20 @@ struct MemoryRegionIoeventfd {
     EventNotifier *e;
 };
 
+/*
+ * A snapshot of the ioeventfds of a region for lockless writers, published
+ * with RCU.  RCU alone only protects the table: the owner of a notifier
+ * may close it as soon as memory_region_del_eventfd() returns.  Writers
+ * therefore count themselves in @inflight, and the table is only retired
+ * once that count drops to zero.
+ */
+typedef struct MemoryRegionIoeventfdTable {
+    struct rcu_head rcu;
+    unsigned inflight;
+    unsigned nb;
+    MemoryRegionIoeventfd fds[];
+} MemoryRegionIoeventfdTable;
+
 static bool memory_region_ioeventfd_before(MemoryRegionIoeventfd *a,
                                            MemoryRegionIoeventfd *b)
 {
@@ -937,26 +968,84 @@ static void flatviews_init(void)
     }
 }
 
+static void memory_region_mark_changed(MemoryRegion *mr)
+{
+    mr->topology_gen = memory_topology_gen;
+}
+
+/*
+ * Whether anything that render_memory_region() would look at below @mr
+ * changed in the current generation.  The answer is cached in the region,
+ * so that regions shared by several FlatViews are only visited once.
+ */
+static bool memory_region_topology_changed(MemoryRegion *mr)
+{
+    MemoryRegion *subregion;
+    bool changed = false;
+
+    if (mr->topology_scan_gen == memory_topology_gen) {
+        return mr->topology_scan_changed;
+    }
+
+    if (mr->topology_gen == memory_topology_gen) {
+        changed = true;
+    } else if (!mr->enabled) {
+        changed = false;
+    } else if (mr->alias) {
+        changed = memory_region_topology_changed(mr->alias);
+    } else {
+        QTAILQ_FOREACH(subregion, &mr->subregions, subregions_link) {
+            if (memory_region_topology_changed(subregion)) {
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    mr->topology_scan_gen = memory_topology_gen;
+    mr->topology_scan_changed = changed;
+    return changed;
+}
+
 static void flatviews_reset(void)
 {
     AddressSpace *as;
+    GHashTable *old_views = flat_views;
+    int64_t start = get_clock();
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
-    /* Render unique FVs */
+    /* Render unique FVs, keeping those whose regions did not change */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *view;
 
         if (g_hash_table_lookup(flat_views, physmr)) {
             continue;
         }
 
+        view = old_views ? g_hash_table_lookup(old_views, physmr) : NULL;
+        if (view && !memory_region_update_all &&
+            !memory_region_topology_changed(physmr)) {
+            flatview_ref(view);
+            g_hash_table_replace(flat_views, physmr, view);
+            flatview_stats.reused++;
+            continue;
+        }
+
         generate_memory_topology(physmr);
+        flatview_stats.rendered++;
     }
+
+    if (old_views) {
+        g_hash_table_unref(old_views);
+    }
+    memory_region_update_all = false;
+    memory_topology_gen++;
+
+    flatview_stats.updates++;
+    flatview_stats.render_ns += get_clock() - start;
 }
 
 static void address_space_set_flatview(AddressSpace *as)
@@ -1405,11 +1494,11 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
 }
 
 /* Return true if an eventfd was signalled */
-static bool memory_region_dispatch_write_eventfds(MemoryRegion *mr,
-                                                    hwaddr addr,
-                                                    uint64_t data,
-                                                    unsigned size,
-                                                    MemTxAttrs attrs)
+static bool memory_region_signal_eventfds(MemoryRegionIoeventfd *fds,
+                                          unsigned nb,
+                                          hwaddr addr,
+                                          uint64_t data,
+                                          unsigned size)
 {
     MemoryRegionIoeventfd ioeventfd = {
         .addr = addrrange_make(int128_make64(addr), int128_make64(size)),
@@ -1417,11 +1506,11 @@ static bool memory_region_dispatch_write_eventfds(MemoryRegion *mr,
     };
     unsigned i;
 
-    for (i = 0; i < mr->ioeventfd_nb; i++) {
-        ioeventfd.match_data = mr->ioeventfds[i].match_data;
-        ioeventfd.e = mr->ioeventfds[i].e;
+    for (i = 0; i < nb; i++) {
+        ioeventfd.match_data = fds[i].match_data;
+        ioeventfd.e = fds[i].e;
 
-        if (memory_region_ioeventfd_equal(&ioeventfd, &mr->ioeventfds[i])) {
+        if (memory_region_ioeventfd_equal(&ioeventfd, &fds[i])) {
             event_notifier_set(ioeventfd.e);
             return true;
         }
@@ -1430,6 +1519,47 @@ static bool memory_region_dispatch_write_eventfds(MemoryRegion *mr,
     return false;
 }
 
+static bool memory_region_dispatch_write_eventfds(MemoryRegion *mr,
+                                                    hwaddr addr,
+                                                    uint64_t data,
+                                                    unsigned size,
+                                                    MemTxAttrs attrs)
+{
+    return memory_region_signal_eventfds(mr->ioeventfds, mr->ioeventfd_nb,
+                                         addr, data, size);
+}
+
+bool memory_region_write_eventfd_lockless(MemoryRegion *mr,
+                                          hwaddr addr,
+                                          uint64_t data,
+                                          unsigned size,
+                                          MemTxAttrs attrs)
+{
+    MemoryRegionIoeventfdTable *table = atomic_rcu_read(&mr->ioeventfd_table);
+    bool ret;
+
+    if (!table || kvm_eventfds_enabled()) {
+        return false;
+    }
+    /* Anything unusual is left to memory_region_dispatch_write() */
+    if (mr->ops->valid.accepts || mr->flush_coalesced_mmio ||
+        !memory_region_access_valid(mr, addr, size, true, attrs)) {
+        return false;
+    }
+
+    /* Pairs with the barrier in memory_region_update_ioeventfd_table() */
+    atomic_inc(&table->inflight);
+    if (atomic_read(&mr->ioeventfd_table) != table) {
+        atomic_dec(&table->inflight);
+        return false;
+    }
+    adjust_endianness(mr, &data, size);
+    ret = memory_region_signal_eventfds(table->fds, table->nb,
+                                        addr, data, size);
+    atomic_dec(&table->inflight);
+    return ret;
+}
+
 MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
                                          hwaddr addr,
                                          uint64_t data,
@@ -1711,6 +1841,7 @@ static void memory_region_finalize(Object *obj)
     memory_region_clear_coalescing(mr);
     g_free((char *)mr->name);
     g_free(mr->ioeventfds);
+    g_free(mr->ioeventfd_table);
 }
 
 Object *memory_region_owner(MemoryRegion *mr)
@@ -1971,6 +2102,7 @@ void memory_region_set_log(MemoryRegion *mr, bool log, unsigned client)
 
     memory_region_transaction_begin();
     mr->dirty_log_mask = (mr->dirty_log_mask & ~mask) | (log * mask);
+    memory_region_mark_changed(mr);
     memory_region_update_pending |= mr->enabled;
     memory_region_transaction_commit();
 }
@@ -2044,6 +2176,7 @@ void memory_region_set_readonly(MemoryRegion *mr, bool readonly)
     if (mr->readonly != readonly) {
         memory_region_transaction_begin();
         mr->readonly = readonly;
+        memory_region_mark_changed(mr);
         memory_region_update_pending |= mr->enabled;
         memory_region_transaction_commit();
     }
@@ -2054,6 +2187,7 @@ void memory_region_set_nonvolatile(MemoryRegion *mr, bool nonvolatile)
     if (mr->nonvolatile != nonvolatile) {
         memory_region_transaction_begin();
         mr->nonvolatile = nonvolatile;
+        memory_region_mark_changed(mr);
         memory_region_update_pending |= mr->enabled;
         memory_region_transaction_commit();
     }
@@ -2064,6 +2198,7 @@ void memory_region_rom_device_set_romd(MemoryRegion *mr, bool romd_mode)
     if (mr->romd_mode != romd_mode) {
         memory_region_transaction_begin();
         mr->romd_mode = romd_mode;
+        memory_region_mark_changed(mr);
         memory_region_update_pending |= mr->enabled;
         memory_region_transaction_commit();
     }
@@ -2234,6 +2369,35 @@ void memory_region_clear_global_locking(MemoryRegion *mr)
     mr->global_locking = false;
 }
 
+/* Publish a new snapshot of the ioeventfds of @mr for lockless writers */
+static void memory_region_update_ioeventfd_table(MemoryRegion *mr)
+{
+    MemoryRegionIoeventfdTable *old = mr->ioeventfd_table;
+    MemoryRegionIoeventfdTable *table = NULL;
+
+    if (mr->ioeventfd_nb) {
+        table = g_malloc0(sizeof(*table) +
+                          mr->ioeventfd_nb * sizeof(table->fds[0]));
+        table->nb = mr->ioeventfd_nb;
+        memcpy(table->fds, mr->ioeventfds,
+               mr->ioeventfd_nb * sizeof(table->fds[0]));
+    }
+    atomic_rcu_set(&mr->ioeventfd_table, table);
+
+    if (old) {
+        /*
+         * Writers that got hold of the old table before it was replaced
+         * may still signal its notifiers.  They do not block, so wait for
+         * them here; later ones see the new table and back off.
+         */
+        smp_mb();
+        while (atomic_read(&old->inflight)) {
+            cpu_relax();
+        }
+        g_free_rcu(old, rcu);
+    }
+}
+
 static bool userspace_eventfd_warning;
 
 void memory_region_add_eventfd(MemoryRegion *mr,
@@ -2274,6 +2438,7 @@ void memory_region_add_eventfd(MemoryRegion *mr,
     memmove(&mr->ioeventfds[i+1], &mr->ioeventfds[i],
             sizeof(*mr->ioeventfds) * (mr->ioeventfd_nb-1 - i));
     mr->ioeventfds[i] = mrfd;
+    memory_region_update_ioeventfd_table(mr);
     ioeventfd_update_pending |= mr->enabled;
     memory_region_transaction_commit();
 }
@@ -2309,6 +2474,7 @@ void memory_region_del_eventfd(MemoryRegion *mr,
     --mr->ioeventfd_nb;
     mr->ioeventfds = g_realloc(mr->ioeventfds,
                                   sizeof(*mr->ioeventfds)*mr->ioeventfd_nb + 1);
+    memory_region_update_ioeventfd_table(mr);
     ioeventfd_update_pending |= mr->enabled;
     memory_region_transaction_commit();
 }
@@ -2329,6 +2495,7 @@ static void memory_region_update_container_subregions(MemoryRegion *subregion)
     }
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
+    memory_region_mark_changed(mr);
     memory_region_update_pending |= mr->enabled && subregion->enabled;
     memory_region_transaction_commit();
 }
@@ -2367,6 +2534,7 @@ void memory_region_del_subregion(MemoryRegion *mr,
     assert(subregion->container == mr);
     subregion->container = NULL;
     QTAILQ_REMOVE(&mr->subregions, subregion, subregions_link);
+    memory_region_mark_changed(mr);
     memory_region_unref(subregion);
     memory_region_update_pending |= mr->enabled && subregion->enabled;
     memory_region_transaction_commit();
@@ -2379,6 +2547,7 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
     }
     memory_region_transaction_begin();
     mr->enabled = enabled;
+    memory_region_mark_changed(mr);
     memory_region_update_pending = true;
     memory_region_transaction_commit();
 }
@@ -2395,6 +2564,7 @@ void memory_region_set_size(MemoryRegion *mr, uint64_t size)
     }
     memory_region_transaction_begin();
     mr->size = s;
+    memory_region_mark_changed(mr);
     memory_region_update_pending = true;
     memory_region_transaction_commit();
 }
@@ -2432,6 +2602,7 @@ void memory_region_set_alias_offset(MemoryRegion *mr, hwaddr offset)
 
     memory_region_transaction_begin();
     mr->alias_offset = offset;
+    memory_region_mark_changed(mr);
     memory_region_update_pending |= mr->enabled;
     memory_region_transaction_commit();
 }
@@ -2556,6 +2727,7 @@ void memory_global_dirty_log_start(void)
 
     /* Refresh DIRTY_LOG_MIGRATION bit.  */
     memory_region_transaction_begin();
+    memory_region_update_all = true;
     memory_region_update_pending = true;
     memory_region_transaction_commit();
 }
@@ -2566,6 +2738,7 @@ static void memory_global_dirty_log_do_stop(void)
 
     /* Refresh DIRTY_LOG_MIGRATION bit.  */
     memory_region_transaction_begin();
+    memory_region_update_all = true;
     memory_region_update_pending = true;
     memory_region_transaction_commit();
 
@@ -2713,6 +2886,11 @@ void address_space_init(AddressSpace *as, MemoryRegion *root, const char *name)
     QTAILQ_INIT(&as->listeners);
     QTAILQ_INSERT_TAIL(&address_spaces, as, address_spaces_link);
     as->name = g_strdup(name ? name : "anonymous");
+    qemu_mutex_init(&as->bounce_lock);
+    as->bounce_buffer_size = 0;
+    as->max_bounce_buffer_size = DEFAULT_MAX_BOUNCE_BUFFER_SIZE;
+    QLIST_INIT(&as->bounce_buffers);
+    QLIST_INIT(&as->map_client_list);
     address_space_update_topology(as);
     address_space_update_ioeventfds(as);
 }
@@ -2720,7 +2898,9 @@ void address_space_init(AddressSpace *as, MemoryRegion *root, const char *name)
 static void do_address_space_destroy(AddressSpace *as)
 {
     assert(QTAILQ_EMPTY(&as->listeners));
-
+    assert(QLIST_EMPTY(&as->bounce_buffers));
+    assert(QLIST_EMPTY(&as->map_client_list));
+    qemu_mutex_destroy(&as->bounce_lock);
     flatview_unref(as->current_map);
     g_free(as->name);
     g_free(as->ioeventfds);
@@ -3029,6 +3209,12 @@ void mtree_info(fprintf_function mon_printf, void *f, bool flatview,
         GArray *fv_address_spaces;
         GHashTable *views = g_hash_table_new(g_direct_hash, g_direct_equal);
 
+        mon_printf(f, "flatview updates: %" PRIu64 ", rendered %" PRIu64
+                   ", reused %" PRIu64 ", %" PRId64 " us spent rendering\n\n",
+                   flatview_stats.updates, flatview_stats.rendered,
+                   flatview_stats.reused,
+                   flatview_stats.render_ns / SCALE_US);
+
         /* Gather all FVs in one table */
         QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
             view = address_space_get_flatview(as);
@@ -19,6 +19,7 @@
 #include "migration/blocker.h"
 #include "exec.h"
 #include "fd.h"
+#include "file.h"
 #include "socket.h"
 #include "rdma.h"
 #include "ram.h"
@@ -86,6 +87,20 @@
  */
 #define DEFAULT_MIGRATE_MAX_POSTCOPY_BANDWIDTH 0
 
+/* Extra host pages requested after a postcopy fault, 0 means only the
+ * faulting page is requested.
+ */
+#define DEFAULT_MIGRATE_POSTCOPY_PREFETCH_PAGES 0
+#define MAX_MIGRATE_POSTCOPY_PREFETCH_PAGES 1024
+
+/* Migration stream buffer size */
+#define DEFAULT_MIGRATE_IO_BUFFER_SIZE (32 * 1024)
+#define MAX_MIGRATE_IO_BUFFER_SIZE (16 * 1024 * 1024)
+
+/* Threads syncing the dirty bitmap, the migration thread included */
+#define DEFAULT_MIGRATE_BITMAP_SYNC_THREADS 1
+#define MAX_MIGRATE_BITMAP_SYNC_THREADS 64
+
 static NotifierList migration_state_notifiers =
     NOTIFIER_LIST_INITIALIZER(migration_state_notifiers);
 
@@ -331,6 +346,8 @@ void qemu_start_incoming_migration(const char *uri, Error **errp)
         unix_start_incoming_migration(p, errp);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_incoming_migration(p, errp);
+    } else if (strstart(uri, "file:", &p)) {
+        file_start_incoming_migration(p, errp);
     } else {
         error_setg(errp, "unknown migration protocol: %s", uri);
     }
@@ -734,6 +751,12 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->max_postcopy_bandwidth = s->parameters.max_postcopy_bandwidth;
     params->has_max_cpu_throttle = true;
     params->max_cpu_throttle = s->parameters.max_cpu_throttle;
+    params->has_postcopy_prefetch_pages = true;
+    params->postcopy_prefetch_pages = s->parameters.postcopy_prefetch_pages;
+    params->has_io_buffer_size = true;
+    params->io_buffer_size = s->parameters.io_buffer_size;
+    params->has_bitmap_sync_threads = true;
+    params->bitmap_sync_threads = s->parameters.bitmap_sync_threads;
 
     return params;
 }
@@ -777,6 +800,8 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
     info->ram->postcopy_requests = ram_counters.postcopy_requests;
     info->ram->page_size = qemu_target_page_size();
     info->ram->multifd_bytes = ram_counters.multifd_bytes;
+    info->ram->flush_stalls = ram_counters.flush_stalls;
+    info->ram->flush_stall_time = ram_counters.flush_stall_time;
 
     if (migrate_use_xbzrle()) {
         info->has_xbzrle_cache = true;
@@ -953,6 +978,32 @@ static bool migrate_caps_check(bool *cap_list,
         }
     }
 
+    if (cap_list[MIGRATION_CAPABILITY_FIXED_RAM]) {
+        /* Pages go straight to their place in the file, not in the stream */
+        if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM] ||
+            cap_list[MIGRATION_CAPABILITY_XBZRLE] ||
+            cap_list[MIGRATION_CAPABILITY_COMPRESS] ||
+            cap_list[MIGRATION_CAPABILITY_X_MULTIFD] ||
+            cap_list[MIGRATION_CAPABILITY_X_COLO]) {
+            error_setg(errp, "Fixed-ram is not compatible with postcopy-ram, "
+                       "xbzrle, compress, x-multifd or x-colo");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_LAZY_RESTORE]) {
+        if (!cap_list[MIGRATION_CAPABILITY_FIXED_RAM]) {
+            error_setg(errp, "Lazy-restore requires fixed-ram");
+            return false;
+        }
+        /* Like postcopy, this needs userfaultfd on the destination */
+        if (runstate_check(RUN_STATE_INMIGRATE) &&
+            !postcopy_ram_supported_by_host(mis)) {
+            error_setg(errp, "Lazy-restore is not supported");
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -1110,6 +1161,35 @@ static bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (params->has_postcopy_prefetch_pages &&
+        params->postcopy_prefetch_pages > MAX_MIGRATE_POSTCOPY_PREFETCH_PAGES) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "postcopy_prefetch_pages",
+                   "an integer in the range of 0 to "
+                   stringify(MAX_MIGRATE_POSTCOPY_PREFETCH_PAGES));
+        return false;
+    }
+
+    if (params->has_io_buffer_size &&
+        (params->io_buffer_size < DEFAULT_MIGRATE_IO_BUFFER_SIZE ||
+         params->io_buffer_size > MAX_MIGRATE_IO_BUFFER_SIZE ||
+         !is_power_of_2(params->io_buffer_size))) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "io_buffer_size",
+                   "a power of two in the range of 32KiB to 16MiB");
+        return false;
+    }
+
+    if (params->has_bitmap_sync_threads &&
+        (params->bitmap_sync_threads < 1 ||
+         params->bitmap_sync_threads > MAX_MIGRATE_BITMAP_SYNC_THREADS)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "bitmap_sync_threads",
+                   "an integer in the range of 1 to "
+                   stringify(MAX_MIGRATE_BITMAP_SYNC_THREADS));
+        return false;
+    }
+
     return true;
 }
 
@@ -1184,6 +1264,15 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_max_cpu_throttle) {
         dest->max_cpu_throttle = params->max_cpu_throttle;
     }
+    if (params->has_postcopy_prefetch_pages) {
+        dest->postcopy_prefetch_pages = params->postcopy_prefetch_pages;
+    }
+    if (params->has_io_buffer_size) {
+        dest->io_buffer_size = params->io_buffer_size;
+    }
+    if (params->has_bitmap_sync_threads) {
+        dest->bitmap_sync_threads = params->bitmap_sync_threads;
+    }
 }
 
 static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
@@ -1266,6 +1355,16 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_max_cpu_throttle) {
         s->parameters.max_cpu_throttle = params->max_cpu_throttle;
     }
+    if (params->has_postcopy_prefetch_pages) {
+        s->parameters.postcopy_prefetch_pages =
+            params->postcopy_prefetch_pages;
+    }
+    if (params->has_io_buffer_size) {
+        s->parameters.io_buffer_size = params->io_buffer_size;
+    }
+    if (params->has_bitmap_sync_threads) {
+        s->parameters.bitmap_sync_threads = params->bitmap_sync_threads;
+    }
 }
 
 void qmp_migrate_set_parameters(MigrateSetParameters *params, Error **errp)
@@ -1798,6 +1897,8 @@ void qmp_migrate(const char *uri, bool has_blk, bool blk,
         unix_start_outgoing_migration(s, p, &local_err);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_outgoing_migration(s, p, &local_err);
+    } else if (strstart(uri, "file:", &p)) {
+        file_start_outgoing_migration(s, p, &local_err);
     } else {
         error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "uri",
                    "a valid migration protocol");
@@ -2052,6 +2153,51 @@ static int64_t migrate_max_postcopy_bandwidth(void)
     return s->parameters.max_postcopy_bandwidth;
 }
 
+bool migrate_fixed_ram(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_FIXED_RAM];
+}
+
+bool migrate_lazy_restore(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_LAZY_RESTORE];
+}
+
+bool migrate_use_async_flush(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_ASYNC_FLUSH];
+}
+
+int migrate_bitmap_sync_threads(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.bitmap_sync_threads;
+}
+
+uint32_t migrate_postcopy_prefetch_pages(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.postcopy_prefetch_pages;
+}
+
 bool migrate_use_block(void)
 {
     MigrationState *s;
@@ -2908,6 +3054,10 @@ static void migration_update_counters(MigrationState *s,
 
     qemu_file_reset_rate_limit(s->to_dst_file);
 
+    ram_counters.flush_stalls = qemu_file_get_flush_stalls(s->to_dst_file);
+    ram_counters.flush_stall_time =
+        qemu_file_get_flush_stall_ns(s->to_dst_file) / SCALE_US;
+
     s->iteration_start_time = current_time;
     s->iteration_initial_bytes = current_bytes;
 
@@ -3158,6 +3308,10 @@ void migrate_fd_connect(MigrationState *s, Error *error_in)
 
     qemu_file_set_rate_limit(s->to_dst_file, rate_limit);
     qemu_file_set_blocking(s->to_dst_file, true);
+    qemu_file_set_buffer_size(s->to_dst_file, s->parameters.io_buffer_size);
+    if (migrate_use_async_flush()) {
+        qemu_file_set_async_flush(s->to_dst_file);
+    }
 
     /*
      * Open the return path. For postcopy, it is used exclusively. For
@@ -3264,6 +3418,15 @@ static Property migration_properties[] = {
     DEFINE_PROP_UINT8("max-cpu-throttle", MigrationState,
                       parameters.max_cpu_throttle,
                       DEFAULT_MIGRATE_MAX_CPU_THROTTLE),
+    DEFINE_PROP_UINT32("postcopy-prefetch-pages", MigrationState,
+                      parameters.postcopy_prefetch_pages,
+                      DEFAULT_MIGRATE_POSTCOPY_PREFETCH_PAGES),
+    DEFINE_PROP_SIZE("io-buffer-size", MigrationState,
+                      parameters.io_buffer_size,
+                      DEFAULT_MIGRATE_IO_BUFFER_SIZE),
+    DEFINE_PROP_UINT8("bitmap-sync-threads", MigrationState,
+                      parameters.bitmap_sync_threads,
+                      DEFAULT_MIGRATE_BITMAP_SYNC_THREADS),
 
     /* Migration capabilities */
     DEFINE_PROP_MIG_CAP("x-xbzrle", MIGRATION_CAPABILITY_XBZRLE),
@@ -3335,6 +3498,9 @@ static void migration_instance_init(Object *obj)
     params->has_xbzrle_cache_size = true;
     params->has_max_postcopy_bandwidth = true;
     params->has_max_cpu_throttle = true;
+    params->has_postcopy_prefetch_pages = true;
+    params->has_io_buffer_size = true;
+    params->has_bitmap_sync_threads = true;
 
     qemu_sem_init(&ms->postcopy_pause_sem, 0);
     qemu_sem_init(&ms->postcopy_pause_rp_sem, 0);
@@ -55,6 +55,9 @@ struct MigrationIncomingState {
     QemuMutex rp_mutex;    /* We send replies from multiple threads */
     /* RAMBlock of last request sent to source */
     RAMBlock *last_rb;
+    /* Range within last_rb covered by the last fault request (bytes) */
+    ram_addr_t last_req_start;
+    ram_addr_t last_req_end;
     void     *postcopy_tmp_page;
     void     *postcopy_tmp_zero_page;
     /* PostCopyFD's for external userfaultfds & handlers of shared memory */
@@ -269,6 +272,11 @@ bool migrate_colo_enabled(void);
 bool migrate_use_block(void);
 bool migrate_use_block_incremental(void);
 int migrate_max_cpu_throttle(void);
+uint32_t migrate_postcopy_prefetch_pages(void);
+int migrate_bitmap_sync_threads(void);
+bool migrate_use_async_flush(void);
+bool migrate_fixed_ram(void);
+bool migrate_lazy_restore(void);
 bool migrate_use_return_path(void);
 
 bool migrate_use_compression(void);
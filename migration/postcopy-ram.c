@@ -463,12 +463,12 @@ static int init_range(const char *block_name, void *host_addr,
 
 /*
  * At the end of migration, undo the effects of init_range
- * opaque should be the MIS.
+ * opaque should point to the userfault fd.
  */
 static int cleanup_range(const char *block_name, void *host_addr,
                         ram_addr_t offset, ram_addr_t length, void *opaque)
 {
-    MigrationIncomingState *mis = opaque;
+    int *userfault_fd = opaque;
     struct uffdio_range range_struct;
     trace_postcopy_cleanup_range(block_name, host_addr, offset, length);
 
@@ -486,7 +486,7 @@ static int cleanup_range(const char *block_name, void *host_addr,
     range_struct.start = (uintptr_t)host_addr;
     range_struct.len = length;
 
-    if (ioctl(mis->userfault_fd, UFFDIO_UNREGISTER, &range_struct)) {
+    if (ioctl(*userfault_fd, UFFDIO_UNREGISTER, &range_struct)) {
         error_report("%s: userfault unregister %s", __func__, strerror(errno));
 
         return -1;
@@ -544,7 +544,8 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
             return -1;
         }
 
-        if (qemu_ram_foreach_migratable_block(cleanup_range, mis)) {
+        if (qemu_ram_foreach_migratable_block(cleanup_range,
+                                              &mis->userfault_fd)) {
             return -1;
         }
 
@@ -623,14 +624,14 @@ int postcopy_ram_prepare_discard(MigrationIncomingState *mis)
  *   host_addr: Base of area to mark
  *   offset: Offset in the whole ram arena
  *   length: Length of the section
- *   opaque: MigrationIncomingState pointer
+ *   opaque: pointer to the userfault fd
  * Returns 0 on success
  */
 static int ram_block_enable_notify(const char *block_name, void *host_addr,
                                    ram_addr_t offset, ram_addr_t length,
                                    void *opaque)
 {
-    MigrationIncomingState *mis = opaque;
+    int *userfault_fd = opaque;
     struct uffdio_register reg_struct;
 
     reg_struct.range.start = (uintptr_t)host_addr;
@@ -638,7 +639,7 @@ static int ram_block_enable_notify(const char *block_name, void *host_addr,
     reg_struct.mode = UFFDIO_REGISTER_MODE_MISSING;
 
     /* Now tell our userfault_fd that it's responsible for this area */
-    if (ioctl(mis->userfault_fd, UFFDIO_REGISTER, &reg_struct)) {
+    if (ioctl(*userfault_fd, UFFDIO_REGISTER, &reg_struct)) {
         error_report("%s userfault register: %s", __func__, strerror(errno));
         return -1;
     }
@@ -694,6 +695,8 @@ int postcopy_request_shared_page(struct PostCopyFD *pcfd, RAMBlock *rb,
     }
     if (rb != mis->last_rb) {
         mis->last_rb = rb;
+        /* The last fault request range was for a different RAMBlock */
+        mis->last_req_start = mis->last_req_end = 0;
         migrate_send_rp_req_pages(mis, qemu_ram_get_idstr(rb),
                                   aligned_rbo, pagesize);
     } else {
@@ -856,6 +859,40 @@ static bool postcopy_pause_fault_thread(MigrationIncomingState *mis)
     return true;
 }
 
+/*
+ * Work out how much to ask the source for on a fault at the host page
+ * aligned @rb_offset: the faulting page itself, followed by up to
+ * postcopy-prefetch-pages host pages that we haven't received yet, so
+ * that sequential accesses don't fault on every page.
+ *
+ * Returns the length of the request in bytes.
+ */
+static size_t postcopy_fault_request_len(RAMBlock *rb, ram_addr_t rb_offset)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    ram_addr_t used_length = qemu_ram_get_used_length(rb);
+    uint32_t prefetch = migrate_postcopy_prefetch_pages();
+    size_t len = pagesize;
+
+    while (prefetch-- && rb_offset + len + pagesize <= used_length &&
+           !ramblock_recv_bitmap_test_byte_offset(rb, rb_offset + len)) {
+        len += pagesize;
+    }
+
+    return len;
+}
+
+/*
+ * Returns true if the host page at @rb_offset was covered by the last
+ * request we sent; the source will send it without being asked again.
+ */
+static bool postcopy_fault_requested(MigrationIncomingState *mis,
+                                     RAMBlock *rb, ram_addr_t rb_offset)
+{
+    return rb == mis->last_rb && rb_offset >= mis->last_req_start &&
+           rb_offset < mis->last_req_end;
+}
+
 /*
  * Handle faults detected by the USERFAULT markings
  */
@@ -893,6 +930,7 @@ static void *postcopy_ram_fault_thread(void *opaque)
 
     while (true) {
         ram_addr_t rb_offset;
+        size_t req_len;
         int poll_result;
 
         /*
@@ -985,23 +1023,34 @@ static void *postcopy_ram_fault_thread(void *opaque)
                     (uintptr_t)(msg.arg.pagefault.address),
                                 msg.arg.pagefault.feat.ptid, rb);
 
+            if (postcopy_fault_requested(mis, rb, rb_offset)) {
+                /* Another vCPU or a prefetch already asked for it */
+                trace_postcopy_ram_fault_thread_requested(
+                    qemu_ram_get_idstr(rb), rb_offset);
+                continue;
+            }
+
 retry:
             /*
-             * Send the request to the source - we want to request one
-             * of our host page sizes (which is >= TPS)
+             * Send the request to the source - we want to request at least
+             * one of our host page sizes (which is >= TPS), followed by
+             * any pages we want to prefetch.
              */
+            req_len = postcopy_fault_request_len(rb, rb_offset);
+            mis->last_req_start = rb_offset;
+            mis->last_req_end = rb_offset + req_len;
             if (rb != mis->last_rb) {
                 mis->last_rb = rb;
                 ret = migrate_send_rp_req_pages(mis,
                                                 qemu_ram_get_idstr(rb),
                                                 rb_offset,
-                                                qemu_ram_pagesize(rb));
+                                                req_len);
             } else {
                 /* Save some space */
                 ret = migrate_send_rp_req_pages(mis,
                                                 NULL,
                                                 rb_offset,
-                                                qemu_ram_pagesize(rb));
+                                                req_len);
             }
 
             if (ret) {
@@ -1116,7 +1165,8 @@ int postcopy_ram_enable_notify(MigrationIncomingState *mis)
     mis->have_fault_thread = true;
 
     /* Mark so that we get notified of accesses to unwritten areas */
-    if (qemu_ram_foreach_migratable_block(ram_block_enable_notify, mis)) {
+    if (qemu_ram_foreach_migratable_block(ram_block_enable_notify,
+                                          &mis->userfault_fd)) {
         return -1;
     }
 
@@ -1131,10 +1181,15 @@ int postcopy_ram_enable_notify(MigrationIncomingState *mis)
     return 0;
 }
 
-static int qemu_ufd_copy_ioctl(int userfault_fd, void *host_addr,
-                               void *from_addr, uint64_t pagesize, RAMBlock *rb)
+/*
+ * Fill the missing page at @host_addr with @from_addr, or with zeroes if
+ * @from_addr is NULL, and wake anyone waiting on it.
+ */
+static int qemu_ufd_place(int userfault_fd, void *host_addr,
+                          void *from_addr, uint64_t pagesize)
 {
     int ret;
+
     if (from_addr) {
         struct uffdio_copy copy_struct;
         copy_struct.dst = (uint64_t)(uintptr_t)host_addr;
@@ -1149,6 +1204,14 @@ static int qemu_ufd_copy_ioctl(int userfault_fd, void *host_addr,
         zero_struct.mode = 0;
         ret = ioctl(userfault_fd, UFFDIO_ZEROPAGE, &zero_struct);
     }
+    return ret;
+}
+
+static int qemu_ufd_copy_ioctl(int userfault_fd, void *host_addr,
+                               void *from_addr, uint64_t pagesize, RAMBlock *rb)
+{
+    int ret = qemu_ufd_place(userfault_fd, host_addr, from_addr, pagesize);
+
     if (!ret) {
         ramblock_recv_bitmap_set_range(rb, host_addr,
                                        pagesize / qemu_target_page_size());
@@ -1270,6 +1333,102 @@ void *postcopy_get_tmp_page(MigrationIncomingState *mis)
     return mis->postcopy_tmp_page;
 }
 
+/*
+ * Lazy restore fills guest RAM from a local file instead of from a
+ * migration source.  It uses its own userfault fd, so that it does not
+ * depend on the incoming migration state outliving the load.
+ */
+static int lazy_restore_ufd = -1;
+
+int postcopy_lazy_restore_enable(void)
+{
+    lazy_restore_ufd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (lazy_restore_ufd == -1) {
+        error_report("%s: Failed to open userfault fd: %s", __func__,
+                     strerror(errno));
+        return -1;
+    }
+
+    if (!ufd_check_and_apply(lazy_restore_ufd, NULL) ||
+        qemu_ram_foreach_migratable_block(ram_block_enable_notify,
+                                          &lazy_restore_ufd)) {
+        close(lazy_restore_ufd);
+        lazy_restore_ufd = -1;
+        return -1;
+    }
+
+    /* As for postcopy, the balloon must not punch holes behind our back */
+    postcopy_balloon_inhibit(true);
+
+    trace_postcopy_lazy_restore_enable();
+    return 0;
+}
+
+void postcopy_lazy_restore_disable(void)
+{
+    qemu_ram_foreach_migratable_block(cleanup_range, &lazy_restore_ufd);
+    close(lazy_restore_ufd);
+    lazy_restore_ufd = -1;
+    postcopy_balloon_inhibit(false);
+
+    trace_postcopy_lazy_restore_disable();
+}
+
+int postcopy_lazy_restore_get_fault(int timeout, RAMBlock **rb,
+                                    ram_addr_t *offset)
+{
+    struct pollfd pfd = { .fd = lazy_restore_ufd, .events = POLLIN };
+    struct uffd_msg msg;
+    void *host;
+    int ret;
+
+    ret = poll(&pfd, 1, timeout);
+    if (ret <= 0) {
+        return ret < 0 && errno != EINTR ? -errno : 0;
+    }
+
+    ret = read(lazy_restore_ufd, &msg, sizeof(msg));
+    if (ret != sizeof(msg)) {
+        if (ret < 0 && errno == EAGAIN) {
+            return 0;
+        }
+        error_report("%s: Failed to read full userfault message", __func__);
+        return -EIO;
+    }
+
+    if (msg.event != UFFD_EVENT_PAGEFAULT) {
+        return 0;
+    }
+
+    host = (void *)(uintptr_t)msg.arg.pagefault.address;
+    *rb = qemu_ram_block_from_host(host, false, offset);
+    if (!*rb) {
+        error_report("%s: Fault outside guest RAM: %p", __func__, host);
+        return -EINVAL;
+    }
+    *offset = QEMU_ALIGN_DOWN(*offset, qemu_ram_pagesize(*rb));
+
+    trace_postcopy_lazy_restore_fault(qemu_ram_get_idstr(*rb), *offset);
+    return 1;
+}
+
+int postcopy_lazy_restore_place(void *host, void *from, RAMBlock *rb)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+
+    /* The guest may have faulted the page in already */
+    if (qemu_ufd_place(lazy_restore_ufd, host, from, pagesize) &&
+        errno != EEXIST) {
+        int e = errno;
+
+        error_report("%s: %s place host: %p (size: %zd)",
+                     __func__, strerror(e), host, pagesize);
+        return -e;
+    }
+
+    return 0;
+}
+
 #else
 /* No target OS support, stubs just fail */
 void fill_destination_postcopy_migration_info(MigrationInfo *info)
@@ -1340,6 +1499,30 @@ int postcopy_wake_shared(struct PostCopyFD *pcfd,
     assert(0);
     return -1;
 }
+
+int postcopy_lazy_restore_enable(void)
+{
+    error_report("%s: No OS support", __func__);
+    return -1;
+}
+
+void postcopy_lazy_restore_disable(void)
+{
+    assert(0);
+}
+
+int postcopy_lazy_restore_get_fault(int timeout, RAMBlock **rb,
+                                    ram_addr_t *offset)
+{
+    assert(0);
+    return -1;
+}
+
+int postcopy_lazy_restore_place(void *host, void *from, RAMBlock *rb)
+{
+    assert(0);
+    return -1;
+}
 #endif
 
 /* ------------------------------------------------------------------------- */
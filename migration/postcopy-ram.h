@@ -189,4 +189,23 @@ int postcopy_wake_shared(struct PostCopyFD *pcfd, uint64_t client_addr,
 int postcopy_request_shared_page(struct PostCopyFD *pcfd, RAMBlock *rb,
                                  uint64_t client_addr, uint64_t offset);
 
+/*
+ * Lazy restore: make accesses to all of (already discarded) RAM fault,
+ * so that pages can be filled from a local file on demand.
+ */
+int postcopy_lazy_restore_enable(void);
+void postcopy_lazy_restore_disable(void);
+/*
+ * Wait up to @timeout ms (-1 forever) for a fault on RAM not yet placed.
+ * Returns 1 with the faulting host page in @rb/@offset, 0 if there was
+ * none, negative on error.  Must be called within an RCU read section.
+ */
+int postcopy_lazy_restore_get_fault(int timeout, RAMBlock **rb,
+                                    ram_addr_t *offset);
+/*
+ * Place a host page, zeroed if @from is NULL; a page that is already
+ * present is left alone.  Returns 0 on success.
+ */
+int postcopy_lazy_restore_place(void *host, void *from, RAMBlock *rb);
+
 #endif
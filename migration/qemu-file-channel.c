@@ -72,6 +72,72 @@ static ssize_t channel_writev_buffer(void *opaque,
 }
 
 
+static ssize_t channel_pwritev_buffer(void *opaque,
+                                      struct iovec *iov,
+                                      int iovcnt,
+                                      int64_t pos)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+    ssize_t done = 0;
+    struct iovec *local_iov = g_new(struct iovec, iovcnt);
+    struct iovec *local_iov_head = local_iov;
+    unsigned int nlocal_iov = iovcnt;
+
+    nlocal_iov = iov_copy(local_iov, nlocal_iov,
+                          iov, iovcnt,
+                          0, iov_size(iov, iovcnt));
+
+    while (nlocal_iov > 0) {
+        ssize_t len;
+        len = qio_channel_pwritev(ioc, local_iov, nlocal_iov, pos + done,
+                                  NULL);
+        if (len <= 0) {
+            /* XXX handle Error objects */
+            done = -EIO;
+            goto cleanup;
+        }
+
+        iov_discard_front(&local_iov, &nlocal_iov, len);
+        done += len;
+    }
+
+ cleanup:
+    g_free(local_iov_head);
+    return done;
+}
+
+
+static ssize_t channel_pread_buffer(void *opaque,
+                                    uint8_t *buf,
+                                    int64_t pos,
+                                    size_t size)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    ssize_t ret;
+
+    ret = qio_channel_preadv(ioc, &iov, 1, pos, NULL);
+    if (ret < 0) {
+        /* XXX handle Error * object */
+        return -EIO;
+    }
+
+    return ret;
+}
+
+
+static int channel_seek(void *opaque, int64_t pos)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+
+    if (qio_channel_io_seek(ioc, pos, SEEK_SET, NULL) < 0) {
+        /* XXX handle Error * object */
+        return -EIO;
+    }
+    return 0;
+}
+
+
 static ssize_t channel_get_buffer(void *opaque,
                                   uint8_t *buf,
                                   int64_t pos,
@@ -177,14 +243,52 @@ static const QEMUFileOps channel_output_ops = {
 };
 
 
+static const QEMUFileOps channel_input_seekable_ops = {
+    .get_buffer = channel_get_buffer,
+    .close = channel_close,
+    .shut_down = channel_shutdown,
+    .set_blocking = channel_set_blocking,
+    .get_return_path = channel_get_input_return_path,
+    .pread_buffer = channel_pread_buffer,
+    .seek = channel_seek,
+};
+
+
+static const QEMUFileOps channel_output_seekable_ops = {
+    .writev_buffer = channel_writev_buffer,
+    .close = channel_close,
+    .shut_down = channel_shutdown,
+    .set_blocking = channel_set_blocking,
+    .get_return_path = channel_get_output_return_path,
+    .pwritev_buffer = channel_pwritev_buffer,
+    .seek = channel_seek,
+};
+
+
 QEMUFile *qemu_fopen_channel_input(QIOChannel *ioc)
 {
+    QEMUFile *f;
+
     object_ref(OBJECT(ioc));
-    return qemu_fopen_ops(ioc, &channel_input_ops);
+    if (qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_SEEKABLE)) {
+        f = qemu_fopen_ops(ioc, &channel_input_seekable_ops);
+    } else {
+        f = qemu_fopen_ops(ioc, &channel_input_ops);
+    }
+    qemu_file_set_ioc(f, ioc);
+    return f;
 }
 
 QEMUFile *qemu_fopen_channel_output(QIOChannel *ioc)
 {
+    QEMUFile *f;
+
     object_ref(OBJECT(ioc));
-    return qemu_fopen_ops(ioc, &channel_output_ops);
+    if (qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_SEEKABLE)) {
+        f = qemu_fopen_ops(ioc, &channel_output_seekable_ops);
+    } else {
+        f = qemu_fopen_ops(ioc, &channel_output_ops);
+    }
+    qemu_file_set_ioc(f, ioc);
+    return f;
 }
@@ -26,10 +26,12 @@
 #include "qemu-common.h"
 #include "qemu/error-report.h"
 #include "qemu/iov.h"
+#include "qemu/timer.h"
 #include "migration.h"
 #include "qemu-file.h"
 #include "trace.h"
 
+/* Default (and minimum) buffer size, and the iovec size that goes with it */
 #define IO_BUF_SIZE 32768
 #define MAX_IOV_SIZE MIN(IOV_MAX, 64)
 
@@ -37,6 +39,7 @@ struct QEMUFile {
     const QEMUFileOps *ops;
     const QEMUFileHooks *hooks;
     void *opaque;
+    QIOChannel *ioc; /* channel the file is opened on, if any */
 
     int64_t bytes_xfer;
     int64_t xfer_limit;
@@ -45,13 +48,35 @@ struct QEMUFile {
                     when reading */
     int buf_index;
     int buf_size; /* 0 when writing */
-    uint8_t buf[IO_BUF_SIZE];
+    int buf_alloc; /* allocated size of buf */
+    uint8_t *buf;
 
-    DECLARE_BITMAP(may_free, MAX_IOV_SIZE);
-    struct iovec iov[MAX_IOV_SIZE];
+    unsigned long *may_free;
+    struct iovec *iov;
     unsigned int iovcnt;
+    unsigned int iov_max;
 
     int last_error;
+
+    /*
+     * Asynchronous flush, see qemu_file_set_async_flush().  While
+     * flush_pending is set, the flush_* buffers belong to the flush
+     * thread; otherwise they are the spare set the writer swaps to.
+     */
+    bool async_flush;
+    QemuThread flush_thread;
+    QemuMutex flush_lock;
+    QemuCond flush_cond;
+    bool flush_pending;
+    bool flush_quit;
+    uint8_t *flush_buf;
+    unsigned long *flush_may_free;
+    struct iovec *flush_iov;
+    unsigned int flush_iovcnt;
+    int64_t flush_pos;
+    /* Times the writer had to wait for the flush thread, and for how long */
+    uint64_t flush_stalls;
+    uint64_t flush_stall_ns;
 };
 
 /*
@@ -98,9 +123,41 @@ QEMUFile *qemu_fopen_ops(void *opaque, const QEMUFileOps *ops)
 
     f->opaque = opaque;
     f->ops = ops;
+    f->buf_alloc = IO_BUF_SIZE;
+    f->buf = g_malloc(f->buf_alloc);
+    f->iov_max = MAX_IOV_SIZE;
+    f->iov = g_new(struct iovec, f->iov_max);
+    f->may_free = bitmap_new(f->iov_max);
     return f;
 }
 
+/*
+ * Change the size of the I/O buffer of @f; sizes below the default are
+ * rounded up to it.  The iovec grows in proportion so that larger
+ * buffers also mean fewer, larger writev calls.
+ *
+ * Must be called before any data has been put to or read from @f.
+ */
+void qemu_file_set_buffer_size(QEMUFile *f, size_t size)
+{
+    assert(!f->buf_index && !f->buf_size && !f->iovcnt && !f->async_flush);
+
+    size = MAX(size, IO_BUF_SIZE);
+    if (size == f->buf_alloc) {
+        return;
+    }
+
+    g_free(f->buf);
+    g_free(f->iov);
+    g_free(f->may_free);
+
+    f->buf_alloc = size;
+    f->buf = g_malloc(f->buf_alloc);
+    f->iov_max = MIN(IOV_MAX, MAX_IOV_SIZE * (size / IO_BUF_SIZE));
+    f->iov = g_new(struct iovec, f->iov_max);
+    f->may_free = bitmap_new(f->iov_max);
+}
+
 
 void qemu_file_set_hooks(QEMUFile *f, const QEMUFileHooks *hooks)
 {
@@ -116,13 +173,14 @@ void qemu_file_set_hooks(QEMUFile *f, const QEMUFileHooks *hooks)
  */
 int qemu_file_get_error(QEMUFile *f)
 {
-    return f->last_error;
+    return atomic_read(&f->last_error);
 }
 
 void qemu_file_set_error(QEMUFile *f, int ret)
 {
-    if (f->last_error == 0) {
-        f->last_error = ret;
+    /* The flush thread may set an error concurrently; keep the first one */
+    if (ret) {
+        atomic_cmpxchg(&f->last_error, 0, ret);
     }
 }
 
@@ -131,39 +189,176 @@ bool qemu_file_is_writable(QEMUFile *f)
     return f->ops->writev_buffer;
 }
 
-static void qemu_iovec_release_ram(QEMUFile *f)
+static void qemu_iovec_release_ram(struct iovec *iovs, unsigned int iovcnt,
+                                   unsigned long *may_free)
 {
     struct iovec iov;
     unsigned long idx;
 
     /* Find and release all the contiguous memory ranges marked as may_free. */
-    idx = find_next_bit(f->may_free, f->iovcnt, 0);
-    if (idx >= f->iovcnt) {
+    idx = find_next_bit(may_free, iovcnt, 0);
+    if (idx >= iovcnt) {
         return;
     }
-    iov = f->iov[idx];
+    iov = iovs[idx];
 
     /* The madvise() in the loop is called for iov within a continuous range and
      * then reinitialize the iov. And in the end, madvise() is called for the
      * last iov.
      */
-    while ((idx = find_next_bit(f->may_free, f->iovcnt, idx + 1)) < f->iovcnt) {
+    while ((idx = find_next_bit(may_free, iovcnt, idx + 1)) < iovcnt) {
         /* check for adjacent buffer and coalesce them */
-        if (iov.iov_base + iov.iov_len == f->iov[idx].iov_base) {
-            iov.iov_len += f->iov[idx].iov_len;
+        if (iov.iov_base + iov.iov_len == iovs[idx].iov_base) {
+            iov.iov_len += iovs[idx].iov_len;
             continue;
         }
         if (qemu_madvise(iov.iov_base, iov.iov_len, QEMU_MADV_DONTNEED) < 0) {
             error_report("migrate: madvise DONTNEED failed %p %zd: %s",
                          iov.iov_base, iov.iov_len, strerror(errno));
         }
-        iov = f->iov[idx];
+        iov = iovs[idx];
     }
     if (qemu_madvise(iov.iov_base, iov.iov_len, QEMU_MADV_DONTNEED) < 0) {
             error_report("migrate: madvise DONTNEED failed %p %zd: %s",
                          iov.iov_base, iov.iov_len, strerror(errno));
     }
-    memset(f->may_free, 0, sizeof(f->may_free));
+    bitmap_zero(may_free, iovcnt);
+}
+
+/*
+ * Write @iovcnt entries of @iov at *@pos, advancing *@pos by the amount
+ * written, and release any RAM marked in @may_free.
+ *
+ * Returns 0 on success or a negative error; a short write is an error.
+ */
+static int qemu_file_writev(QEMUFile *f, struct iovec *iov,
+                            unsigned int iovcnt, unsigned long *may_free,
+                            int64_t *pos)
+{
+    ssize_t expect = iov_size(iov, iovcnt);
+    ssize_t ret;
+
+    ret = f->ops->writev_buffer(f->opaque, iov, iovcnt, *pos);
+    qemu_iovec_release_ram(iov, iovcnt, may_free);
+
+    if (ret >= 0) {
+        *pos += ret;
+    }
+    /* We expect the QEMUFile write impl to send the full
+     * data set we requested, so sanity check that.
+     */
+    if (ret != expect) {
+        return ret < 0 ? ret : -EIO;
+    }
+    return 0;
+}
+
+/*
+ * Wait until the flush thread is done with the spare buffers, accounting
+ * the time as a stall of the writer.
+ */
+static void qemu_file_flush_wait(QEMUFile *f)
+{
+    int64_t start;
+
+    qemu_mutex_lock(&f->flush_lock);
+    if (f->flush_pending) {
+        start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+        while (f->flush_pending) {
+            qemu_cond_wait(&f->flush_cond, &f->flush_lock);
+        }
+        f->flush_stalls++;
+        f->flush_stall_ns += qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
+    }
+    qemu_mutex_unlock(&f->flush_lock);
+}
+
+static void *qemu_file_flush_thread(void *opaque)
+{
+    QEMUFile *f = opaque;
+    int ret;
+
+    qemu_mutex_lock(&f->flush_lock);
+    while (true) {
+        while (!f->flush_pending && !f->flush_quit) {
+            qemu_cond_wait(&f->flush_cond, &f->flush_lock);
+        }
+        if (!f->flush_pending) {
+            break;
+        }
+        qemu_mutex_unlock(&f->flush_lock);
+
+        trace_qemu_file_flush_thread(f->flush_iovcnt);
+        ret = qemu_file_writev(f, f->flush_iov, f->flush_iovcnt,
+                               f->flush_may_free, &f->flush_pos);
+        if (ret < 0) {
+            /* The writer picks this up through qemu_file_get_error() */
+            atomic_cmpxchg(&f->last_error, 0, ret);
+        }
+
+        qemu_mutex_lock(&f->flush_lock);
+        f->flush_pending = false;
+        qemu_cond_broadcast(&f->flush_cond);
+    }
+    qemu_mutex_unlock(&f->flush_lock);
+
+    return NULL;
+}
+
+/*
+ * Write out the buffer of @f from a separate thread, so that the caller
+ * can keep filling a second buffer while the first one is on its way.
+ * Explicit qemu_fflush() calls remain synchronous.
+ *
+ * Files with hooks (RDMA) write data behind the back of the buffer and
+ * keep flushing synchronously.
+ */
+void qemu_file_set_async_flush(QEMUFile *f)
+{
+    assert(qemu_file_is_writable(f));
+
+    if (f->hooks || f->async_flush) {
+        return;
+    }
+
+    f->flush_buf = g_malloc(f->buf_alloc);
+    f->flush_iov = g_new(struct iovec, f->iov_max);
+    f->flush_may_free = bitmap_new(f->iov_max);
+    qemu_mutex_init(&f->flush_lock);
+    qemu_cond_init(&f->flush_cond);
+    f->async_flush = true;
+    qemu_thread_create(&f->flush_thread, "mig/flush", qemu_file_flush_thread,
+                       f, QEMU_THREAD_JOINABLE);
+}
+
+static void qemu_file_async_flush_cleanup(QEMUFile *f)
+{
+    if (!f->async_flush) {
+        return;
+    }
+
+    qemu_mutex_lock(&f->flush_lock);
+    f->flush_quit = true;
+    qemu_cond_broadcast(&f->flush_cond);
+    qemu_mutex_unlock(&f->flush_lock);
+    qemu_thread_join(&f->flush_thread);
+
+    qemu_cond_destroy(&f->flush_cond);
+    qemu_mutex_destroy(&f->flush_lock);
+    g_free(f->flush_buf);
+    g_free(f->flush_iov);
+    g_free(f->flush_may_free);
+    f->async_flush = false;
+}
+
+uint64_t qemu_file_get_flush_stalls(QEMUFile *f)
+{
+    return f->flush_stalls;
+}
+
+uint64_t qemu_file_get_flush_stall_ns(QEMUFile *f)
+{
+    return f->flush_stall_ns;
 }
 
 /**
@@ -175,29 +370,68 @@ static void qemu_iovec_release_ram(QEMUFile *f)
  */
 void qemu_fflush(QEMUFile *f)
 {
-    ssize_t ret = 0;
-    ssize_t expect = 0;
+    int ret;
 
     if (!qemu_file_is_writable(f)) {
         return;
     }
 
-    if (f->iovcnt > 0) {
-        expect = iov_size(f->iov, f->iovcnt);
-        ret = f->ops->writev_buffer(f->opaque, f->iov, f->iovcnt, f->pos);
-
-        qemu_iovec_release_ram(f);
+    if (f->async_flush) {
+        /* Anything handed to the flush thread must hit the wire first */
+        qemu_file_flush_wait(f);
     }
 
-    if (ret >= 0) {
-        f->pos += ret;
+    if (f->iovcnt > 0) {
+        ret = qemu_file_writev(f, f->iov, f->iovcnt, f->may_free, &f->pos);
+        if (ret < 0) {
+            qemu_file_set_error(f, ret);
+        }
     }
-    /* We expect the QEMUFile write impl to send the full
-     * data set we requested, so sanity check that.
-     */
-    if (ret != expect) {
-        qemu_file_set_error(f, ret < 0 ? ret : -EIO);
+    f->buf_index = 0;
+    f->iovcnt = 0;
+}
+
+/*
+ * Called when the buffer or the iovec fills up.  With asynchronous flush
+ * enabled, swap the full buffer with the spare one and let the flush
+ * thread write it; the writer only blocks if the previous buffer is still
+ * being written.
+ */
+static void qemu_fflush_full(QEMUFile *f)
+{
+    uint8_t *buf;
+    struct iovec *iov;
+    unsigned long *may_free;
+    size_t size;
+
+    if (!f->async_flush) {
+        qemu_fflush(f);
+        return;
     }
+
+    qemu_file_flush_wait(f);
+
+    size = iov_size(f->iov, f->iovcnt);
+    buf = f->flush_buf;
+    iov = f->flush_iov;
+    may_free = f->flush_may_free;
+
+    qemu_mutex_lock(&f->flush_lock);
+    f->flush_buf = f->buf;
+    f->flush_iov = f->iov;
+    f->flush_may_free = f->may_free;
+    f->flush_iovcnt = f->iovcnt;
+    f->flush_pos = f->pos;
+    f->flush_pending = f->iovcnt > 0;
+    qemu_cond_broadcast(&f->flush_cond);
+    qemu_mutex_unlock(&f->flush_lock);
+
+    /* Account the data as written, an error is reported separately */
+    f->pos += size;
+
+    f->buf = buf;
+    f->iov = iov;
+    f->may_free = may_free;
     f->buf_index = 0;
     f->iovcnt = 0;
 }
@@ -295,7 +529,7 @@ static ssize_t qemu_fill_buffer(QEMUFile *f)
     f->buf_size = pending;
 
     len = f->ops->get_buffer(f->opaque, f->buf + pending, f->pos,
-                        IO_BUF_SIZE - pending);
+                        f->buf_alloc - pending);
     if (len > 0) {
         f->buf_size += len;
         f->pos += len;
@@ -325,6 +559,7 @@ int qemu_fclose(QEMUFile *f)
 {
     int ret;
     qemu_fflush(f);
+    qemu_file_async_flush_cleanup(f);
     ret = qemu_file_get_error(f);
 
     if (f->ops->close) {
@@ -339,6 +574,9 @@ int qemu_fclose(QEMUFile *f)
     if (f->last_error) {
         ret = f->last_error;
     }
+    g_free(f->buf);
+    g_free(f->iov);
+    g_free(f->may_free);
     g_free(f);
     trace_qemu_file_fclose();
     return ret;
@@ -361,8 +599,8 @@ static void add_to_iovec(QEMUFile *f, const uint8_t *buf, size_t size,
         f->iov[f->iovcnt++].iov_len = size;
     }
 
-    if (f->iovcnt >= MAX_IOV_SIZE) {
-        qemu_fflush(f);
+    if (f->iovcnt >= f->iov_max) {
+        qemu_fflush_full(f);
     }
 }
 
@@ -377,6 +615,90 @@ void qemu_put_buffer_async(QEMUFile *f, const uint8_t *buf, size_t size,
     add_to_iovec(f, buf, size, may_free);
 }
 
+void qemu_file_set_ioc(QEMUFile *f, QIOChannel *ioc)
+{
+    f->ioc = ioc;
+}
+
+QIOChannel *qemu_file_get_ioc(QEMUFile *f)
+{
+    return f->ioc;
+}
+
+bool qemu_file_is_seekable(QEMUFile *f)
+{
+    return qemu_file_is_writable(f) ? f->ops->pwritev_buffer != NULL :
+                                      f->ops->pread_buffer != NULL;
+}
+
+void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t size,
+                        int64_t pos)
+{
+    struct iovec iov = { .iov_base = (uint8_t *)buf, .iov_len = size };
+    ssize_t ret;
+
+    if (f->last_error) {
+        return;
+    }
+
+    f->bytes_xfer += size;
+    ret = f->ops->pwritev_buffer(f->opaque, &iov, 1, pos);
+    if (ret != size) {
+        qemu_file_set_error(f, ret < 0 ? ret : -EIO);
+    }
+}
+
+/*
+ * Returns size on success; anything less means an error was set on @f.
+ */
+size_t qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t size,
+                          int64_t pos)
+{
+    size_t done = 0;
+    ssize_t ret;
+
+    if (f->last_error) {
+        return 0;
+    }
+
+    while (done < size) {
+        ret = f->ops->pread_buffer(f->opaque, buf + done, pos + done,
+                                   size - done);
+        if (ret <= 0) {
+            qemu_file_set_error(f, ret < 0 ? ret : -EIO);
+            break;
+        }
+        done += ret;
+    }
+
+    return done;
+}
+
+/*
+ * Move the stream position to @pos; buffered data is written out first
+ * when writing, and dropped when reading.
+ */
+void qemu_set_offset(QEMUFile *f, int64_t pos)
+{
+    int ret;
+
+    if (qemu_file_is_writable(f)) {
+        qemu_fflush(f);
+    } else {
+        f->buf_index = 0;
+        f->buf_size = 0;
+    }
+
+    if (f->ops->seek) {
+        ret = f->ops->seek(f->opaque, pos);
+        if (ret < 0) {
+            qemu_file_set_error(f, ret);
+            return;
+        }
+    }
+    f->pos = pos;
+}
+
 void qemu_put_buffer(QEMUFile *f, const uint8_t *buf, size_t size)
 {
     size_t l;
@@ -386,7 +708,7 @@ void qemu_put_buffer(QEMUFile *f, const uint8_t *buf, size_t size)
     }
 
     while (size > 0) {
-        l = IO_BUF_SIZE - f->buf_index;
+        l = f->buf_alloc - f->buf_index;
         if (l > size) {
             l = size;
         }
@@ -394,8 +716,8 @@ void qemu_put_buffer(QEMUFile *f, const uint8_t *buf, size_t size)
         f->bytes_xfer += l;
         add_to_iovec(f, f->buf + f->buf_index, l, false);
         f->buf_index += l;
-        if (f->buf_index == IO_BUF_SIZE) {
-            qemu_fflush(f);
+        if (f->buf_index == f->buf_alloc) {
+            qemu_fflush_full(f);
         }
         if (qemu_file_get_error(f)) {
             break;
@@ -415,8 +737,8 @@ void qemu_put_byte(QEMUFile *f, int v)
     f->bytes_xfer++;
     add_to_iovec(f, f->buf + f->buf_index, 1, false);
     f->buf_index++;
-    if (f->buf_index == IO_BUF_SIZE) {
-        qemu_fflush(f);
+    if (f->buf_index == f->buf_alloc) {
+        qemu_fflush_full(f);
     }
 }
 
@@ -441,8 +763,8 @@ size_t qemu_peek_buffer(QEMUFile *f, uint8_t **buf, size_t size, size_t offset)
     size_t index;
 
     assert(!qemu_file_is_writable(f));
-    assert(offset < IO_BUF_SIZE);
-    assert(size <= IO_BUF_SIZE - offset);
+    assert(offset < f->buf_alloc);
+    assert(size <= f->buf_alloc - offset);
 
     /* The 1st byte to read from */
     index = f->buf_index + offset;
@@ -492,7 +814,7 @@ size_t qemu_get_buffer(QEMUFile *f, uint8_t *buf, size_t size)
         size_t res;
         uint8_t *src;
 
-        res = qemu_peek_buffer(f, &src, MIN(pending, IO_BUF_SIZE), 0);
+        res = qemu_peek_buffer(f, &src, MIN(pending, f->buf_alloc), 0);
         if (res == 0) {
             return done;
         }
@@ -526,7 +848,7 @@ size_t qemu_get_buffer(QEMUFile *f, uint8_t *buf, size_t size)
  */
 size_t qemu_get_buffer_in_place(QEMUFile *f, uint8_t **buf, size_t size)
 {
-    if (size < IO_BUF_SIZE) {
+    if (size < f->buf_alloc) {
         size_t res;
         uint8_t *src;
 
@@ -551,7 +873,7 @@ int qemu_peek_byte(QEMUFile *f, int offset)
     int index = f->buf_index + offset;
 
     assert(!qemu_file_is_writable(f));
-    assert(offset < IO_BUF_SIZE);
+    assert(offset < f->buf_alloc);
 
     if (index >= f->buf_size) {
         qemu_fill_buffer(f);
@@ -698,14 +1020,14 @@ static int qemu_compress_data(z_stream *stream, uint8_t *dest, size_t dest_len,
 ssize_t qemu_put_compression_data(QEMUFile *f, z_stream *stream,
                                   const uint8_t *p, size_t size)
 {
-    ssize_t blen = IO_BUF_SIZE - f->buf_index - sizeof(int32_t);
+    ssize_t blen = f->buf_alloc - f->buf_index - sizeof(int32_t);
 
     if (blen < compressBound(size)) {
         if (!qemu_file_is_writable(f)) {
             return -1;
         }
-        qemu_fflush(f);
-        blen = IO_BUF_SIZE - sizeof(int32_t);
+        qemu_fflush_full(f);
+        blen = f->buf_alloc - sizeof(int32_t);
         if (blen < compressBound(size)) {
             return -1;
         }
@@ -722,8 +1044,8 @@ ssize_t qemu_put_compression_data(QEMUFile *f, z_stream *stream,
         add_to_iovec(f, f->buf + f->buf_index, blen, false);
     }
     f->buf_index += blen;
-    if (f->buf_index == IO_BUF_SIZE) {
-        qemu_fflush(f);
+    if (f->buf_index == f->buf_alloc) {
+        qemu_fflush_full(f);
     }
     return blen + sizeof(int32_t);
 }
@@ -26,6 +26,7 @@
 #define MIGRATION_QEMU_FILE_H
 
 #include <zlib.h>
+#include "io/channel.h"
 
 /* Read a chunk of data from a file at the given position.  The pos argument
  * can be ignored if the file is only be used for streaming.  The number of
@@ -99,6 +100,14 @@ typedef QEMUFile *(QEMURetPathFunc)(void *opaque);
  */
 typedef int (QEMUFileShutdownFunc)(void *opaque, bool rd, bool wr);
 
+/*
+ * Move the position the next get_buffer/writev_buffer call works at
+ * to 'pos'.  Optional: backends that honour the 'pos' argument of those
+ * calls leave it NULL.
+ * Returns 0 on success, -err on error
+ */
+typedef int (QEMUFileSeekFunc)(void *opaque, int64_t pos);
+
 typedef struct QEMUFileOps {
     QEMUFileGetBufferFunc *get_buffer;
     QEMUFileCloseFunc *close;
@@ -106,6 +115,10 @@ typedef struct QEMUFileOps {
     QEMUFileWritevBufferFunc *writev_buffer;
     QEMURetPathFunc *get_return_path;
     QEMUFileShutdownFunc *shut_down;
+    /* Optional random access to the underlying file */
+    QEMUFileWritevBufferFunc *pwritev_buffer;
+    QEMUFileGetBufferFunc *pread_buffer;
+    QEMUFileSeekFunc *seek;
 } QEMUFileOps;
 
 typedef struct QEMUFileHooks {
@@ -117,6 +130,13 @@ typedef struct QEMUFileHooks {
 
 QEMUFile *qemu_fopen_ops(void *opaque, const QEMUFileOps *ops);
 void qemu_file_set_hooks(QEMUFile *f, const QEMUFileHooks *hooks);
+void qemu_file_set_buffer_size(QEMUFile *f, size_t size);
+void qemu_file_set_async_flush(QEMUFile *f);
+uint64_t qemu_file_get_flush_stalls(QEMUFile *f);
+uint64_t qemu_file_get_flush_stall_ns(QEMUFile *f);
+/* The channel a QEMUFile was opened on, NULL if it is not channel based */
+void qemu_file_set_ioc(QEMUFile *f, QIOChannel *ioc);
+QIOChannel *qemu_file_get_ioc(QEMUFile *f);
 int qemu_get_fd(QEMUFile *f);
 int qemu_fclose(QEMUFile *f);
 int64_t qemu_ftell(QEMUFile *f);
@@ -127,6 +147,17 @@ int64_t qemu_ftell_fast(QEMUFile *f);
  */
 void qemu_put_buffer_async(QEMUFile *f, const uint8_t *buf, size_t size,
                            bool may_free);
+/*
+ * Random access for seekable files: these read/write at an explicit
+ * offset, bypassing the buffer, and leave the stream position alone;
+ * qemu_set_offset() moves the stream position itself.
+ */
+bool qemu_file_is_seekable(QEMUFile *f);
+void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t size,
+                        int64_t pos);
+size_t qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t size,
+                          int64_t pos);
+void qemu_set_offset(QEMUFile *f, int64_t pos);
 bool qemu_file_mode_is_not_valid(const char *mode);
 bool qemu_file_is_writable(QEMUFile *f);
 
@@ -30,6 +30,7 @@
 #include "cpu.h"
 #include <zlib.h>
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/main-loop.h"
@@ -41,6 +42,7 @@
 #include "migration/register.h"
 #include "migration/misc.h"
 #include "qemu-file.h"
+#include "io/channel-file.h"
 #include "postcopy-ram.h"
 #include "page_cache.h"
 #include "qemu/error-report.h"
@@ -76,6 +78,11 @@
 #define RAM_SAVE_FLAG_XBZRLE   0x40
 /* 0x80 is reserved in migration.h start with 0x100 next */
 #define RAM_SAVE_FLAG_COMPRESS_PAGE    0x100
+/* Only valid together with MEM_SIZE: the stream uses the fixed-ram layout */
+#define RAM_SAVE_FLAG_FIXED_RAM        0x200
+
+/* Alignment of each block's page area in a fixed-ram migration file */
+#define FIXED_RAM_FILE_ALIGN (1 * MiB)
 
 static inline bool is_zero_range(uint8_t *p, uint64_t size)
 {
@@ -1572,6 +1579,162 @@ static void migration_bitmap_sync_range(RAMState *rs, RAMBlock *rb,
                                               &rs->num_dirty_pages_period);
 }
 
+/* Parallel bitmap sync */
+
+/*
+ * RAM is handed out to the sync threads in chunks of this size.  It is a
+ * multiple of BITS_PER_LONG target pages for any target page size, so
+ * chunks of a block never share a word of its migration bitmap and keep
+ * the word-at-a-time path of cpu_physical_memory_sync_dirty_bitmap().
+ */
+#define BITMAP_SYNC_CHUNK (256 * MiB)
+
+typedef struct {
+    RAMBlock *block;
+    ram_addr_t start;
+    ram_addr_t length;
+} BitmapSyncChunk;
+
+typedef struct {
+    QemuThread thread;
+    /* posted to start a sync, or to quit */
+    QemuSemaphore sem;
+    bool quit;
+    /* results of the last sync, see migration_bitmap_sync_range() */
+    uint64_t dirty_pages;
+    uint64_t dirty_pages_period;
+} BitmapSyncParam;
+
+static struct {
+    /* number of threads taking part, the migration thread included */
+    int thread_count;
+    /* per thread state; the migration thread uses the first one */
+    BitmapSyncParam *params;
+    QemuSemaphore done_sem;
+    GArray *chunks;
+    unsigned int next_chunk;
+} bitmap_sync;
+
+static void bitmap_sync_do_chunks(BitmapSyncParam *param)
+{
+    unsigned int i;
+
+    param->dirty_pages = 0;
+    param->dirty_pages_period = 0;
+    while ((i = atomic_fetch_inc(&bitmap_sync.next_chunk)) <
+           bitmap_sync.chunks->len) {
+        BitmapSyncChunk *chunk = &g_array_index(bitmap_sync.chunks,
+                                                BitmapSyncChunk, i);
+
+        param->dirty_pages +=
+            cpu_physical_memory_sync_dirty_bitmap(chunk->block, chunk->start,
+                                                  chunk->length,
+                                                  &param->dirty_pages_period);
+    }
+}
+
+static void *bitmap_sync_thread(void *opaque)
+{
+    BitmapSyncParam *param = opaque;
+
+    rcu_register_thread();
+    while (true) {
+        qemu_sem_wait(&param->sem);
+        if (atomic_read(&param->quit)) {
+            break;
+        }
+        bitmap_sync_do_chunks(param);
+        qemu_sem_post(&bitmap_sync.done_sem);
+    }
+    rcu_unregister_thread();
+
+    return NULL;
+}
+
+static void bitmap_sync_threads_setup(void)
+{
+    int i;
+
+    bitmap_sync.thread_count = migrate_bitmap_sync_threads();
+    bitmap_sync.params = g_new0(BitmapSyncParam, bitmap_sync.thread_count);
+    bitmap_sync.chunks = g_array_new(false, false, sizeof(BitmapSyncChunk));
+    qemu_sem_init(&bitmap_sync.done_sem, 0);
+    for (i = 1; i < bitmap_sync.thread_count; i++) {
+        qemu_sem_init(&bitmap_sync.params[i].sem, 0);
+        qemu_thread_create(&bitmap_sync.params[i].thread, "mig/bmapsync",
+                           bitmap_sync_thread, &bitmap_sync.params[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void bitmap_sync_threads_cleanup(void)
+{
+    int i;
+
+    if (!bitmap_sync.params) {
+        return;
+    }
+    for (i = 1; i < bitmap_sync.thread_count; i++) {
+        atomic_set(&bitmap_sync.params[i].quit, true);
+        qemu_sem_post(&bitmap_sync.params[i].sem);
+        qemu_thread_join(&bitmap_sync.params[i].thread);
+        qemu_sem_destroy(&bitmap_sync.params[i].sem);
+    }
+    qemu_sem_destroy(&bitmap_sync.done_sem);
+    g_array_free(bitmap_sync.chunks, true);
+    g_free(bitmap_sync.params);
+    bitmap_sync.params = NULL;
+    bitmap_sync.thread_count = 0;
+}
+
+/*
+ * Sync the dirty log of all migratable blocks into their migration
+ * bitmaps, split across the bitmap sync threads when there are any.
+ * Called with bitmap_mutex and the RCU read lock held.
+ */
+static void migration_bitmap_sync_all(RAMState *rs)
+{
+    RAMBlock *block;
+    int i;
+
+    if (bitmap_sync.thread_count <= 1) {
+        RAMBLOCK_FOREACH_MIGRATABLE(block) {
+            migration_bitmap_sync_range(rs, block, 0, block->used_length);
+        }
+        return;
+    }
+
+    g_array_set_size(bitmap_sync.chunks, 0);
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        ram_addr_t start;
+
+        for (start = 0; start < block->used_length;
+             start += BITMAP_SYNC_CHUNK) {
+            BitmapSyncChunk chunk = {
+                .block = block,
+                .start = start,
+                .length = MIN(BITMAP_SYNC_CHUNK, block->used_length - start),
+            };
+
+            g_array_append_val(bitmap_sync.chunks, chunk);
+        }
+    }
+    atomic_set(&bitmap_sync.next_chunk, 0);
+
+    for (i = 1; i < bitmap_sync.thread_count; i++) {
+        qemu_sem_post(&bitmap_sync.params[i].sem);
+    }
+    bitmap_sync_do_chunks(&bitmap_sync.params[0]);
+    for (i = 1; i < bitmap_sync.thread_count; i++) {
+        qemu_sem_wait(&bitmap_sync.done_sem);
+    }
+
+    for (i = 0; i < bitmap_sync.thread_count; i++) {
+        rs->migration_dirty_pages += bitmap_sync.params[i].dirty_pages;
+        rs->num_dirty_pages_period += bitmap_sync.params[i].dirty_pages_period;
+    }
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -1635,7 +1798,6 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
 
 static void migration_bitmap_sync(RAMState *rs)
 {
-    RAMBlock *block;
     int64_t end_time;
     uint64_t bytes_xfer_now;
 
@@ -1650,9 +1812,7 @@ static void migration_bitmap_sync(RAMState *rs)
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     rcu_read_lock();
-    RAMBLOCK_FOREACH_MIGRATABLE(block) {
-        migration_bitmap_sync_range(rs, block, 0, block->used_length);
-    }
+    migration_bitmap_sync_all(rs);
     ram_counters.remaining = ram_bytes_remaining();
     rcu_read_unlock();
     qemu_mutex_unlock(&rs->bitmap_mutex);
@@ -1744,6 +1904,43 @@ static int save_zero_page(RAMState *rs, RAMBlock *block, ram_addr_t offset)
     return -1;
 }
 
+/**
+ * save_fixed_ram_page: write a page at its fixed place in the file
+ *
+ * Returns the number of pages written.  Zero pages are not written at
+ * all, they are only cleared from the block's file bitmap.
+ *
+ * @rs: current RAM state
+ * @block: block that contains the page we want to send
+ * @offset: offset inside the block for the page
+ */
+static int save_fixed_ram_page(RAMState *rs, RAMBlock *block,
+                               ram_addr_t offset)
+{
+    uint8_t *p = block->host + offset;
+    unsigned long page = offset >> TARGET_PAGE_BITS;
+
+    if (is_zero_range(p, TARGET_PAGE_SIZE)) {
+        clear_bit(page, block->file_bmap);
+        ram_counters.duplicate++;
+        return 1;
+    }
+
+    qemu_put_buffer_at(rs->f, p, TARGET_PAGE_SIZE,
+                       block->pages_offset + offset);
+    set_bit(page, block->file_bmap);
+    ram_counters.normal++;
+    ram_counters.transferred += TARGET_PAGE_SIZE;
+    return 1;
+}
+
+/* Size in bytes of a fixed-ram file bitmap, padded as for the recv bitmap */
+static uint64_t fixed_ram_bitmap_size(RAMBlock *block)
+{
+    return ROUND_UP(DIV_ROUND_UP(block->used_length >> TARGET_PAGE_BITS, 8),
+                    8);
+}
+
 static void ram_release_pages(const char *rbname, uint64_t offset, int pages)
 {
     if (!migrate_release_ram() || !migration_in_postcopy()) {
@@ -2320,6 +2517,10 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
         return res;
     }
 
+    if (migrate_fixed_ram()) {
+        return save_fixed_ram_page(rs, block, offset);
+    }
+
     if (save_compress_page(rs, block, offset)) {
         return 1;
     }
@@ -2538,10 +2739,13 @@ static void ram_save_cleanup(void *opaque)
         block->bmap = NULL;
         g_free(block->unsentmap);
         block->unsentmap = NULL;
+        g_free(block->file_bmap);
+        block->file_bmap = NULL;
     }
 
     xbzrle_cleanup();
     compress_threads_save_cleanup();
+    bitmap_sync_threads_cleanup();
     ram_state_cleanup(rsp);
 }
 
@@ -3134,6 +3338,51 @@ static void ram_state_resume_prepare(RAMState *rs, QEMUFile *out)
  * granularity of these critical sections.
  */
 
+/*
+ * Reserve room in the file for the block's page bitmap and its pages,
+ * and record where they live.  The pages area is aligned so that the
+ * destination can read large runs of pages straight into guest memory.
+ */
+static int ram_save_fixed_ram_setup(QEMUFile *f, RAMBlock *block)
+{
+    unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
+
+    if (!qemu_file_is_seekable(f)) {
+        error_report("fixed-ram needs a seekable migration target");
+        return -1;
+    }
+
+    block->file_bmap = bitmap_new(pages);
+    block->bitmap_offset = qemu_ftell(f) + 2 * sizeof(uint64_t);
+    block->pages_offset = ROUND_UP(block->bitmap_offset +
+                                   fixed_ram_bitmap_size(block),
+                                   FIXED_RAM_FILE_ALIGN);
+    qemu_put_be64(f, block->bitmap_offset);
+    qemu_put_be64(f, block->pages_offset);
+    qemu_set_offset(f, block->pages_offset + block->used_length);
+
+    trace_ram_save_fixed_ram_setup(block->idstr, block->bitmap_offset,
+                                   block->pages_offset);
+    return qemu_file_get_error(f);
+}
+
+/* Write out the final page bitmap of each block to its reserved area */
+static void ram_save_fixed_ram_bitmaps(QEMUFile *f)
+{
+    RAMBlock *block;
+
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
+        unsigned long *le_bitmap = bitmap_new(pages + BITS_PER_LONG);
+
+        bitmap_to_le(le_bitmap, block->file_bmap, pages);
+        qemu_put_buffer_at(f, (uint8_t *)le_bitmap,
+                           fixed_ram_bitmap_size(block),
+                           block->bitmap_offset);
+        g_free(le_bitmap);
+    }
+}
+
 /**
  * ram_save_setup: Setup RAM for migration
  *
@@ -3150,10 +3399,12 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
     if (compress_threads_save_setup()) {
         return -1;
     }
+    bitmap_sync_threads_setup();
 
     /* migration has already setup the bitmap, reuse it. */
     if (!migration_in_colo_state()) {
         if (ram_init_all(rsp) != 0) {
+            bitmap_sync_threads_cleanup();
             compress_threads_save_cleanup();
             return -1;
         }
@@ -3162,7 +3413,8 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
 
     rcu_read_lock();
 
-    qemu_put_be64(f, ram_bytes_total() | RAM_SAVE_FLAG_MEM_SIZE);
+    qemu_put_be64(f, ram_bytes_total() | RAM_SAVE_FLAG_MEM_SIZE |
+                  (migrate_fixed_ram() ? RAM_SAVE_FLAG_FIXED_RAM : 0));
 
     RAMBLOCK_FOREACH_MIGRATABLE(block) {
         qemu_put_byte(f, strlen(block->idstr));
@@ -3171,6 +3423,12 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
         if (migrate_postcopy_ram() && block->page_size != qemu_host_page_size) {
             qemu_put_be64(f, block->page_size);
         }
+        if (migrate_fixed_ram()) {
+            if (ram_save_fixed_ram_setup(f, block) < 0) {
+                rcu_read_unlock();
+                return -1;
+            }
+        }
     }
 
     rcu_read_unlock();
@@ -3323,6 +3581,10 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
     flush_compressed_data(rs);
     ram_control_after_iterate(f, RAM_CONTROL_FINISH);
 
+    if (!ret && migrate_fixed_ram()) {
+        ram_save_fixed_ram_bitmaps(f);
+    }
+
     rcu_read_unlock();
 
     multifd_send_sync_main();
@@ -3970,6 +4232,309 @@ static bool postcopy_is_advised(void)
     return ps >= POSTCOPY_INCOMING_ADVISE && ps < POSTCOPY_INCOMING_END;
 }
 
+/*
+ * Lazy restore reads the migration file after the load has finished, so
+ * it only works when that is a plain file; returns NULL otherwise.
+ */
+static QIOChannelFile *ram_lazy_restore_file(QEMUFile *f)
+{
+    QIOChannel *ioc = qemu_file_get_ioc(f);
+
+    if (!ioc || !object_dynamic_cast(OBJECT(ioc), TYPE_QIO_CHANNEL_FILE)) {
+        return NULL;
+    }
+    return QIO_CHANNEL_FILE(ioc);
+}
+
+/* Read the pages set in @bitmap into @block, zero the others */
+static int ram_load_fixed_ram_pages(QEMUFile *f, RAMBlock *block,
+                                    unsigned long *bitmap)
+{
+    unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
+    unsigned long start, end;
+
+    for (start = 0; start < pages; start = end) {
+        void *host = block->host + (start << TARGET_PAGE_BITS);
+        size_t len;
+
+        if (test_bit(start, bitmap)) {
+            end = find_next_zero_bit(bitmap, pages, start);
+            len = (end - start) << TARGET_PAGE_BITS;
+            if (qemu_get_buffer_at(f, host, len,
+                                   block->pages_offset +
+                                   (start << TARGET_PAGE_BITS)) != len) {
+                error_report("%s: failed to read pages of ramblock '%s'",
+                             __func__, block->idstr);
+                return -EIO;
+            }
+        } else {
+            end = find_next_bit(bitmap, pages, start);
+            len = (end - start) << TARGET_PAGE_BITS;
+            ram_handle_compressed(host, 0, len);
+        }
+        ramblock_recv_bitmap_set_range(block, host, end - start);
+    }
+
+    return 0;
+}
+
+/*
+ * Load a block saved with fixed-ram: read its page bitmap, then load
+ * the pages now or, with lazy-restore, on demand once the guest runs.
+ */
+static int ram_load_fixed_ram(QEMUFile *f, RAMBlock *block)
+{
+    unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
+    uint64_t bmap_size = fixed_ram_bitmap_size(block);
+    unsigned long *le_bitmap, *bitmap;
+    int ret = 0;
+
+    if (migrate_lazy_restore() && !ram_lazy_restore_file(f)) {
+        error_report("lazy-restore needs a file: migration source");
+        return -EINVAL;
+    }
+
+    block->bitmap_offset = qemu_get_be64(f);
+    block->pages_offset = qemu_get_be64(f);
+    trace_ram_load_fixed_ram(block->idstr, block->bitmap_offset,
+                             block->pages_offset);
+
+    le_bitmap = bitmap_new(pages + BITS_PER_LONG);
+    bitmap = bitmap_new(pages);
+    if (qemu_get_buffer_at(f, (uint8_t *)le_bitmap, bmap_size,
+                           block->bitmap_offset) != bmap_size) {
+        error_report("%s: failed to read bitmap of ramblock '%s'",
+                     __func__, block->idstr);
+        ret = -EIO;
+        goto out;
+    }
+    bitmap_from_le(bitmap, le_bitmap, pages);
+
+    if (migrate_lazy_restore()) {
+        /*
+         * Leave the pages in the file for the lazy restore thread, and
+         * empty the block so that every guest access to it faults.
+         */
+        block->file_bmap = bitmap;
+        bitmap = NULL;
+        ret = ram_discard_range(block->idstr, 0, block->used_length);
+        if (ret) {
+            goto out;
+        }
+    } else {
+        ret = ram_load_fixed_ram_pages(f, block, bitmap);
+        if (ret) {
+            goto out;
+        }
+    }
+
+    qemu_set_offset(f, block->pages_offset + block->used_length);
+    ret = qemu_file_get_error(f);
+
+out:
+    g_free(le_bitmap);
+    g_free(bitmap);
+    return ret;
+}
+
+/* Number of host pages read ahead between two checks for guest faults */
+#define LAZY_RESTORE_BATCH 16
+
+typedef struct RAMLazyRestore {
+    QemuThread thread;
+    /* our own handle on the migration file, which is closed after load */
+    QIOChannel *ioc;
+    /* staging buffer for one host page */
+    uint8_t *page;
+    /* blocks still backed by the file, in read-ahead order */
+    GPtrArray *blocks;
+} RAMLazyRestore;
+
+/*
+ * Fill the host page at @offset of @rb from the migration file, and map
+ * it into the guest.  Does nothing if the guest already has the page.
+ */
+static int ram_lazy_restore_page(RAMLazyRestore *lr, RAMBlock *rb,
+                                 ram_addr_t offset)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    unsigned long first = offset >> TARGET_PAGE_BITS;
+    unsigned long last = first + (pagesize >> TARGET_PAGE_BITS);
+    unsigned long start, end;
+    Error *local_err = NULL;
+
+    if (find_next_bit(rb->file_bmap, last, first) >= last &&
+        qemu_ram_is_uf_zeroable(rb)) {
+        return postcopy_lazy_restore_place(rb->host + offset, NULL, rb);
+    }
+
+    for (start = first; start < last; start = end) {
+        uint8_t *buf = lr->page + ((start - first) << TARGET_PAGE_BITS);
+        struct iovec iov;
+
+        if (!test_bit(start, rb->file_bmap)) {
+            end = find_next_bit(rb->file_bmap, last, start);
+            memset(buf, 0, (end - start) << TARGET_PAGE_BITS);
+            continue;
+        }
+
+        end = find_next_zero_bit(rb->file_bmap, last, start);
+        iov.iov_base = buf;
+        iov.iov_len = (end - start) << TARGET_PAGE_BITS;
+        if (qio_channel_preadv(lr->ioc, &iov, 1,
+                               rb->pages_offset + (start << TARGET_PAGE_BITS),
+                               &local_err) != iov.iov_len) {
+            if (local_err) {
+                error_report_err(local_err);
+            }
+            error_report("%s: failed to read page 0x" RAM_ADDR_FMT
+                         " of ramblock '%s'", __func__, offset, rb->idstr);
+            return -EIO;
+        }
+    }
+
+    return postcopy_lazy_restore_place(rb->host + offset, lr->page, rb);
+}
+
+/*
+ * Serve a guest fault on @offset of @rb, then read ahead the pages that
+ * follow it, as postcopy-prefetch-pages does for postcopy.
+ */
+static int ram_lazy_restore_fault(RAMLazyRestore *lr, RAMBlock *rb,
+                                  ram_addr_t offset)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    ram_addr_t end = offset +
+        (ram_addr_t)pagesize * (1 + migrate_postcopy_prefetch_pages());
+    int ret = 0;
+
+    end = MIN(end, rb->used_length);
+    for (; !ret && offset < end; offset += pagesize) {
+        ret = ram_lazy_restore_page(lr, rb, offset);
+    }
+    return ret;
+}
+
+static void ram_lazy_restore_finish(void *opaque)
+{
+    RAMLazyRestore *lr = opaque;
+    unsigned int i;
+
+    qemu_thread_join(&lr->thread);
+    postcopy_lazy_restore_disable();
+
+    for (i = 0; i < lr->blocks->len; i++) {
+        RAMBlock *rb = g_ptr_array_index(lr->blocks, i);
+
+        g_free(rb->file_bmap);
+        rb->file_bmap = NULL;
+    }
+    g_ptr_array_free(lr->blocks, true);
+    object_unref(OBJECT(lr->ioc));
+    qemu_vfree(lr->page);
+    g_free(lr);
+}
+
+/*
+ * Serve guest faults first; whenever there are none, read the blocks in
+ * order in the background.  Once everything is in place, hand back to the
+ * main loop to tear down.  On error the guest is left waiting on the page
+ * that could not be read, as with a failed postcopy.
+ */
+static void *ram_lazy_restore_thread(void *opaque)
+{
+    RAMLazyRestore *lr = opaque;
+    unsigned int i = 0;
+    ram_addr_t offset = 0;
+    int64_t start_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    int ret = 0;
+
+    rcu_register_thread();
+
+    while (!ret && i < lr->blocks->len) {
+        RAMBlock *rb;
+        ram_addr_t fault_offset;
+        int n;
+
+        rcu_read_lock();
+        ret = postcopy_lazy_restore_get_fault(0, &rb, &fault_offset);
+        if (ret > 0) {
+            ret = ram_lazy_restore_fault(lr, rb, fault_offset);
+        }
+        for (n = 0; !ret && n < LAZY_RESTORE_BATCH &&
+                    i < lr->blocks->len; n++) {
+            rb = g_ptr_array_index(lr->blocks, i);
+            ret = ram_lazy_restore_page(lr, rb, offset);
+            offset += qemu_ram_pagesize(rb);
+            if (offset >= rb->used_length) {
+                i++;
+                offset = 0;
+            }
+        }
+        rcu_read_unlock();
+    }
+
+    rcu_unregister_thread();
+
+    if (ret) {
+        error_report("Lazy restore failed: %s", strerror(-ret));
+    } else {
+        trace_ram_lazy_restore_done(qemu_clock_get_ms(QEMU_CLOCK_REALTIME) -
+                                    start_time);
+        aio_bh_schedule_oneshot(qemu_get_aio_context(),
+                                ram_lazy_restore_finish, lr);
+    }
+    return NULL;
+}
+
+/*
+ * Called once all blocks of a lazy restore have been set up: take our
+ * own reference to the file, make guest RAM fault and start serving it.
+ */
+static int ram_lazy_restore_start(QEMUFile *f)
+{
+    QIOChannelFile *fioc = ram_lazy_restore_file(f);
+    RAMLazyRestore *lr;
+    RAMBlock *block;
+    int fd;
+
+    fd = dup(fioc->fd);
+    if (fd < 0) {
+        int e = errno;
+
+        error_report("%s: failed to dup migration file: %s", __func__,
+                     strerror(e));
+        return -e;
+    }
+    qemu_set_cloexec(fd);
+
+    lr = g_new0(RAMLazyRestore, 1);
+    lr->ioc = QIO_CHANNEL(qio_channel_file_new_fd(fd));
+    lr->page = qemu_memalign(qemu_real_host_page_size,
+                             qemu_ram_pagesize_largest());
+    lr->blocks = g_ptr_array_new();
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        if (block->file_bmap) {
+            g_ptr_array_add(lr->blocks, block);
+        }
+    }
+
+    if (!qio_channel_has_feature(lr->ioc, QIO_CHANNEL_FEATURE_SEEKABLE) ||
+        postcopy_lazy_restore_enable()) {
+        error_report("lazy-restore could not be enabled");
+        g_ptr_array_free(lr->blocks, true);
+        object_unref(OBJECT(lr->ioc));
+        qemu_vfree(lr->page);
+        g_free(lr);
+        return -EINVAL;
+    }
+
+    trace_ram_lazy_restore_start(lr->blocks->len);
+    qemu_thread_create(&lr->thread, "mig/lazy", ram_lazy_restore_thread, lr,
+                       QEMU_THREAD_JOINABLE);
+    return 0;
+}
+
 static bool postcopy_is_running(void)
 {
     PostcopyState ps = postcopy_state_get();
@@ -4067,6 +4632,24 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
             break;
         }
 
+        if (flags & RAM_SAVE_FLAG_MEM_SIZE) {
+            bool fixed_ram = flags & RAM_SAVE_FLAG_FIXED_RAM;
+
+            if (fixed_ram != migrate_fixed_ram()) {
+                error_report("Stream %s the fixed-ram layout but the "
+                             "fixed-ram capability is %s",
+                             fixed_ram ? "uses" : "does not use",
+                             migrate_fixed_ram() ? "on" : "off");
+                ret = -EINVAL;
+                break;
+            }
+            flags &= ~RAM_SAVE_FLAG_FIXED_RAM;
+        } else if (flags & RAM_SAVE_FLAG_FIXED_RAM) {
+            error_report("Unexpected fixed-ram flag in a page header");
+            ret = -EINVAL;
+            break;
+        }
+
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
                      RAM_SAVE_FLAG_COMPRESS_PAGE | RAM_SAVE_FLAG_XBZRLE)) {
             RAMBlock *block = ram_block_from_stream(f, flags);
@@ -4132,6 +4715,9 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
                             ret = -EINVAL;
                         }
                     }
+                    if (!ret && migrate_fixed_ram()) {
+                        ret = ram_load_fixed_ram(f, block);
+                    }
                     ram_control_load_hook(f, RAM_CONTROL_BLOCK_REG,
                                           block->idstr);
                 } else {
@@ -4142,6 +4728,9 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
 
                 total_ram_bytes -= length;
             }
+            if (!ret && migrate_fixed_ram() && migrate_lazy_restore()) {
+                ret = ram_lazy_restore_start(f);
+            }
             break;
 
         case RAM_SAVE_FLAG_ZERO:
@@ -216,13 +216,15 @@ static int bdrv_fclose(void *opaque)
 }
 
 static const QEMUFileOps bdrv_read_ops = {
-    .get_buffer = block_get_buffer,
-    .close =      bdrv_fclose
+    .get_buffer   = block_get_buffer,
+    .close        = bdrv_fclose,
+    .pread_buffer = block_get_buffer,
 };
 
 static const QEMUFileOps bdrv_write_ops = {
     .writev_buffer  = block_writev_buffer,
-    .close          = bdrv_fclose
+    .close          = bdrv_fclose,
+    .pwritev_buffer = block_writev_buffer,
 };
 
 static QEMUFile *qemu_fopen_bdrv(BlockDriverState *bs, int is_writable)
@@ -16,6 +16,7 @@
 #include "qemu/osdep.h"
 #include "qemu-version.h"
 #include "qemu/cutils.h"
+#include "qemu/coroutine.h"
 #include "qemu/option.h"
 #include "monitor/monitor.h"
 #include "sysemu/sysemu.h"
@@ -85,6 +86,20 @@ UuidInfo *qmp_query_uuid(Error **errp)
     return info;
 }
 
+CoroutinePoolInfo *qmp_query_coroutine_pool(Error **errp)
+{
+    CoroutinePoolInfo *info = g_new0(CoroutinePoolInfo, 1);
+    CoroutinePoolStats stats;
+
+    qemu_coroutine_get_pool_stats(&stats);
+    info->pool_hits = stats.pool_hits;
+    info->allocations = stats.allocations;
+    info->frees = stats.frees;
+    info->max_stack_usage = stats.max_stack_usage;
+    info->stack_size = stats.stack_size;
+    return info;
+}
+
 void qmp_quit(Error **errp)
 {
     no_shutdown = 0;
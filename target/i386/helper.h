@@ -74,6 +74,8 @@ DEF_HELPER_1(rsm, void, env)
 DEF_HELPER_2(into, void, env, int)
 DEF_HELPER_2(cmpxchg8b_unlocked, void, env, tl)
 DEF_HELPER_2(cmpxchg8b, void, env, tl)
+DEF_HELPER_5(rep_movs, void, env, tl, tl, i32, i32)
+DEF_HELPER_4(rep_stos, void, env, tl, i32, i32)
 #ifdef TARGET_X86_64
 DEF_HELPER_2(cmpxchg16b_unlocked, void, env, tl)
 DEF_HELPER_2(cmpxchg16b, void, env, tl)
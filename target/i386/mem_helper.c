@@ -192,6 +192,170 @@ void helper_boundl(CPUX86State *env, target_ulong a0, int v)
     }
 }
 
+/*
+ * Bulk part of REP MOVS and REP STOS.  As many elements as fit in the
+ * current source and destination pages are processed with a single
+ * probe_access() per page, and rCX, rSI and rDI are updated to match.
+ * Whatever is left, including an element that straddles two pages or an
+ * access to I/O memory, is done one element at a time by the translated
+ * loop, which calls us again on the next iteration.
+ */
+static target_ulong rep_addr_mask(int aflag)
+{
+    switch (aflag) {
+    case MO_16:
+        return 0xffff;
+    case MO_32:
+        return 0xffffffff;
+    default:
+        return -1;
+    }
+}
+
+static void rep_set_reg(CPUX86State *env, int reg, target_ulong val,
+                        int aflag)
+{
+    switch (aflag) {
+    case MO_16:
+        env->regs[reg] = (env->regs[reg] & ~0xffff) | (val & 0xffff);
+        break;
+    case MO_32:
+        env->regs[reg] = (uint32_t)val;
+        break;
+    default:
+        env->regs[reg] = val;
+        break;
+    }
+}
+
+/*
+ * Number of elements of 1 << @shift bytes, starting at linear address
+ * @addr and register offset @reg and going in the direction of DF, that
+ * stay within the page of @addr without wrapping @reg around @mask.
+ */
+static target_ulong rep_elems(CPUX86State *env, target_ulong addr,
+                              target_ulong reg, int shift, target_ulong mask)
+{
+    target_ulong size = 1 << shift;
+    target_ulong in_page = addr & ~TARGET_PAGE_MASK;
+    target_ulong room;
+
+    reg &= mask;
+    room = mask - reg;
+    if (in_page + size > TARGET_PAGE_SIZE || room < size - 1) {
+        return 0;
+    }
+    if (env->df > 0) {
+        return MIN((TARGET_PAGE_SIZE - in_page) >> shift,
+                   ((room - (size - 1)) >> shift) + 1);
+    } else {
+        return MIN(in_page >> shift, reg >> shift) + 1;
+    }
+}
+
+/*
+ * Host address of the element at @addr.  The elements that rep_elems()
+ * counted are all on the page of @addr, so probing the first one in DF
+ * order covers them, and a fault is reported at the address of the
+ * element that real hardware would have faulted on.
+ */
+static void *rep_probe(CPUX86State *env, target_ulong addr, int shift,
+                       MMUAccessType access_type, uintptr_t ra)
+{
+    return probe_access(env, addr, 1 << shift, access_type,
+                        cpu_mmu_index(env, false), ra);
+}
+
+void helper_rep_movs(CPUX86State *env, target_ulong dst, target_ulong src,
+                     uint32_t ot, uint32_t aflag)
+{
+    target_ulong mask = rep_addr_mask(aflag);
+    intptr_t step = env->df * (1 << ot);
+    target_ulong n, i;
+    uint8_t *d, *s;
+
+    n = MIN(env->regs[R_ECX] & mask,
+            MIN(rep_elems(env, dst, env->regs[R_EDI], ot, mask),
+                rep_elems(env, src, env->regs[R_ESI], ot, mask)));
+    if (n == 0) {
+        return;
+    }
+    s = rep_probe(env, src, ot, MMU_DATA_LOAD, GETPC());
+    if (!s) {
+        return;
+    }
+    d = rep_probe(env, dst, ot, MMU_DATA_STORE, GETPC());
+    if (!d) {
+        return;
+    }
+
+    /* One element at a time, since overlapping copies are well defined */
+    for (i = 0; i < n; i++, d += step, s += step) {
+        switch (ot) {
+        case MO_8:
+            stb_p(d, ldub_p(s));
+            break;
+        case MO_16:
+            stw_le_p(d, lduw_le_p(s));
+            break;
+        case MO_32:
+            stl_le_p(d, ldl_le_p(s));
+            break;
+        default:
+            stq_le_p(d, ldq_le_p(s));
+            break;
+        }
+    }
+
+    rep_set_reg(env, R_ECX, env->regs[R_ECX] - n, aflag);
+    rep_set_reg(env, R_ESI, env->regs[R_ESI] + n * step, aflag);
+    rep_set_reg(env, R_EDI, env->regs[R_EDI] + n * step, aflag);
+}
+
+void helper_rep_stos(CPUX86State *env, target_ulong dst, uint32_t ot,
+                     uint32_t aflag)
+{
+    target_ulong mask = rep_addr_mask(aflag);
+    target_ulong val = env->regs[R_EAX];
+    intptr_t step = env->df * (1 << ot);
+    target_ulong n, i;
+    uint8_t *d;
+
+    n = MIN(env->regs[R_ECX] & mask,
+            rep_elems(env, dst, env->regs[R_EDI], ot, mask));
+    if (n == 0) {
+        return;
+    }
+    d = rep_probe(env, dst, ot, MMU_DATA_STORE, GETPC());
+    if (!d) {
+        return;
+    }
+
+    switch (ot) {
+    case MO_8:
+        memset(step > 0 ? d : d - n + 1, val, n);
+        break;
+    default:
+        for (i = 0; i < n; i++, d += step) {
+            switch (ot) {
+            case MO_16:
+                stw_le_p(d, val);
+                break;
+            case MO_32:
+                stl_le_p(d, val);
+                break;
+            default:
+                stq_le_p(d, val);
+                break;
+            }
+        }
+        break;
+    }
+
+    rep_set_reg(env, R_ECX, env->regs[R_ECX] - n, aflag);
+    rep_set_reg(env, R_EDI, env->regs[R_EDI] + n * step, aflag);
+}
+
 #if !defined(CONFIG_USER_ONLY)
 /* try to fill the TLB and return an exception if error. If retaddr is
  * NULL, it means that the function was called in C code (i.e. not
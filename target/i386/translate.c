@@ -1204,8 +1204,57 @@ static inline void gen_repz_ ## op(DisasContext *s, TCGMemOp ot,              \
     gen_jmp(s, cur_eip);                                                      \
 }
 
-GEN_REPZ(movs)
-GEN_REPZ(stos)
+/* REP MOVS and REP STOS first let a helper do as many iterations as it
+   can directly on host memory, one TLB check per page, then go through
+   the generic loop for the element that follows.  Not when every
+   iteration must be observable: single-stepping, icount.  */
+static inline bool use_repz_bulk(DisasContext *s)
+{
+    return s->jmp_opt && !(tb_cflags(s->base.tb) & CF_USE_ICOUNT);
+}
+
+static inline void gen_repz_movs(DisasContext *s, TCGMemOp ot,
+                                 target_ulong cur_eip, target_ulong next_eip)
+{
+    TCGLabel *l2;
+    gen_update_cc_op(s);
+    l2 = gen_jz_ecx_string(s, next_eip);
+    if (use_repz_bulk(s)) {
+        gen_string_movl_A0_ESI(s);
+        tcg_gen_mov_tl(s->T1, s->A0);
+        gen_string_movl_A0_EDI(s);
+        gen_helper_rep_movs(cpu_env, s->A0, s->T1,
+                            tcg_const_i32(ot), tcg_const_i32(s->aflag));
+        gen_op_jz_ecx(s, s->aflag, l2);
+    }
+    gen_movs(s, ot);
+    gen_op_add_reg_im(s, s->aflag, R_ECX, -1);
+    if (s->repz_opt) {
+        gen_op_jz_ecx(s, s->aflag, l2);
+    }
+    gen_jmp(s, cur_eip);
+}
+
+static inline void gen_repz_stos(DisasContext *s, TCGMemOp ot,
+                                 target_ulong cur_eip, target_ulong next_eip)
+{
+    TCGLabel *l2;
+    gen_update_cc_op(s);
+    l2 = gen_jz_ecx_string(s, next_eip);
+    if (use_repz_bulk(s)) {
+        gen_string_movl_A0_EDI(s);
+        gen_helper_rep_stos(cpu_env, s->A0,
+                            tcg_const_i32(ot), tcg_const_i32(s->aflag));
+        gen_op_jz_ecx(s, s->aflag, l2);
+    }
+    gen_stos(s, ot);
+    gen_op_add_reg_im(s, s->aflag, R_ECX, -1);
+    if (s->repz_opt) {
+        gen_op_jz_ecx(s, s->aflag, l2);
+    }
+    gen_jmp(s, cur_eip);
+}
+
 GEN_REPZ(lods)
 GEN_REPZ(ins)
 GEN_REPZ(outs)
@@ -2220,6 +2269,7 @@ static inline void gen_goto_tb(DisasContext *s, int tb_num, target_ulong eip)
 {
     target_ulong pc = s->cs_base + eip;
 
+    translator_note_goto_tb(tb_num, pc);
     if (use_goto_tb(s, pc))  {
         /* jump to same page: we can use a direct jump */
         tcg_gen_goto_tb(tb_num);
@@ -530,6 +530,14 @@ typedef enum {
     I3616_ORR       = 0x0ea01c00,
     I3616_ORN       = 0x0ee01c00,
     I3616_SUB       = 0x2e208400,
+    I3616_SQADD     = 0x0e200c00,
+    I3616_UQADD     = 0x2e200c00,
+    I3616_SQSUB     = 0x0e202c00,
+    I3616_UQSUB     = 0x2e202c00,
+    I3616_SMAX      = 0x0e206400,
+    I3616_UMAX      = 0x2e206400,
+    I3616_SMIN      = 0x0e206c00,
+    I3616_UMIN      = 0x2e206c00,
     I3616_CMGT      = 0x0e203400,
     I3616_CMGE      = 0x0e203c00,
     I3616_CMTST     = 0x0e208c00,
@@ -2163,6 +2171,30 @@ static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc,
     case INDEX_op_not_vec:
         tcg_out_insn(s, 3617, NOT, is_q, 0, a0, a1);
         break;
+    case INDEX_op_ssadd_vec:
+        tcg_out_insn(s, 3616, SQADD, is_q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_sssub_vec:
+        tcg_out_insn(s, 3616, SQSUB, is_q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_usadd_vec:
+        tcg_out_insn(s, 3616, UQADD, is_q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_ussub_vec:
+        tcg_out_insn(s, 3616, UQSUB, is_q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_smax_vec:
+        tcg_out_insn(s, 3616, SMAX, is_q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_smin_vec:
+        tcg_out_insn(s, 3616, SMIN, is_q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_umax_vec:
+        tcg_out_insn(s, 3616, UMAX, is_q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_umin_vec:
+        tcg_out_insn(s, 3616, UMIN, is_q, vece, a0, a1, a2);
+        break;
     case INDEX_op_dup_vec:
         tcg_out_insn(s, 3605, DUP, is_q, a0, a1, 1 << vece, 0);
         break;
@@ -2232,7 +2264,17 @@ int tcg_can_emit_vec_op(TCGOpcode opc, TCGType type, unsigned vece)
     case INDEX_op_sari_vec:
         return 1;
     case INDEX_op_mul_vec:
+    case INDEX_op_smax_vec:
+    case INDEX_op_smin_vec:
+    case INDEX_op_umax_vec:
+    case INDEX_op_umin_vec:
         return vece < MO_64;
+    case INDEX_op_ssadd_vec:
+    case INDEX_op_sssub_vec:
+    case INDEX_op_usadd_vec:
+    case INDEX_op_ussub_vec:
+        /* The 1D arrangement is reserved for the vector form.  */
+        return vece < MO_64 || type == TCG_TYPE_V128;
 
     default:
         return 0;
@@ -2409,6 +2451,14 @@ static const TCGTargetOpDef *tcg_target_op_def(TCGOpcode op)
     case INDEX_op_xor_vec:
     case INDEX_op_andc_vec:
     case INDEX_op_orc_vec:
+    case INDEX_op_ssadd_vec:
+    case INDEX_op_sssub_vec:
+    case INDEX_op_usadd_vec:
+    case INDEX_op_ussub_vec:
+    case INDEX_op_smax_vec:
+    case INDEX_op_smin_vec:
+    case INDEX_op_umax_vec:
+    case INDEX_op_umin_vec:
         return &w_w_w;
     case INDEX_op_not_vec:
     case INDEX_op_neg_vec:
@@ -2429,6 +2479,12 @@ static const TCGTargetOpDef *tcg_target_op_def(TCGOpcode op)
     }
 }
 
+/* All the instructions this backend uses are part of the base ISA */
+static uint64_t tcg_target_feature_mask(void)
+{
+    return 0;
+}
+
 static void tcg_target_init(TCGContext *s)
 {
     tcg_target_available_regs[TCG_TYPE_I32] = 0xffffffffu;
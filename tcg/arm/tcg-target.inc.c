@@ -2213,6 +2213,12 @@ static const TCGTargetOpDef *tcg_target_op_def(TCGOpcode op)
     }
 }
 
+/* Host features the code generated by this backend depends on */
+static uint64_t tcg_target_feature_mask(void)
+{
+    return (uint64_t)arm_arch << 1 | use_idiv_instructions;
+}
+
 static void tcg_target_init(TCGContext *s)
 {
     /* Only probe for the platform and capabilities if we havn't already
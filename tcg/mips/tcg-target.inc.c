@@ -2617,6 +2617,14 @@ static void tcg_target_qemu_prologue(TCGContext *s)
     tcg_out_opc_reg(s, OPC_OR, TCG_TMP3, TCG_TMP3, TCG_TMP1);
 }
 
+/* Host features the code generated by this backend depends on */
+static uint64_t tcg_target_feature_mask(void)
+{
+    return (uint64_t)use_movnz_instructions
+        | (uint64_t)use_mips32_instructions << 1
+        | (uint64_t)use_mips32r2_instructions << 2;
+}
+
 static void tcg_target_init(TCGContext *s)
 {
     tcg_target_detect_isa();
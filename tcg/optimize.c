@@ -587,6 +587,225 @@ static bool swap_commutative2(TCGArg *p1, TCGArg *p2)
     return false;
 }
 
+/* Mark the global behind @ts as read, along with its base if indirect. */
+static void dead_globals_use(unsigned long *dead, TCGTemp *ts, int nb_globals)
+{
+    size_t idx = temp_idx(ts);
+
+    if (idx < nb_globals) {
+        clear_bit(idx, dead);
+        if (ts->indirect_reg) {
+            clear_bit(temp_idx(ts->mem_base), dead);
+        }
+    }
+}
+
+/* Number of bytes of host memory accessed by @op, 0 if not a host load/store */
+static int dead_globals_mem_size(const TCGOp *op)
+{
+    switch (op->opc) {
+    case INDEX_op_ld8u_i32:
+    case INDEX_op_ld8s_i32:
+    case INDEX_op_st8_i32:
+    case INDEX_op_ld8u_i64:
+    case INDEX_op_ld8s_i64:
+    case INDEX_op_st8_i64:
+        return 1;
+    case INDEX_op_ld16u_i32:
+    case INDEX_op_ld16s_i32:
+    case INDEX_op_st16_i32:
+    case INDEX_op_ld16u_i64:
+    case INDEX_op_ld16s_i64:
+    case INDEX_op_st16_i64:
+        return 2;
+    case INDEX_op_ld_i32:
+    case INDEX_op_st_i32:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld32s_i64:
+    case INDEX_op_st32_i64:
+        return 4;
+    case INDEX_op_ld_i64:
+    case INDEX_op_st_i64:
+        return 8;
+    case INDEX_op_ld_vec:
+    case INDEX_op_st_vec:
+        return 8 << TCGOP_VECL(op);
+    default:
+        return 0;
+    }
+}
+
+/*
+ * A host load or store of @size bytes at @base + @ofs touches the memory
+ * backing every global based on @base that it overlaps; count it as a use
+ * of those globals.  A base that is not a global may point anywhere into
+ * env, so it uses all of them.
+ */
+static void dead_globals_use_mem(TCGContext *s, unsigned long *dead,
+                                 TCGTemp *base, intptr_t ofs, int size)
+{
+    int nb_globals = s->nb_globals;
+    int i;
+
+    if (temp_idx(base) >= nb_globals) {
+        bitmap_zero(dead, nb_globals);
+        return;
+    }
+    for (i = 0; i < nb_globals; i++) {
+        TCGTemp *ts = &s->temps[i];
+        intptr_t ts_size = ts->type == TCG_TYPE_I32 ? 4 : 8;
+
+        if (ts->mem_base == base &&
+            ts->mem_offset < ofs + size && ofs < ts->mem_offset + ts_size) {
+            clear_bit(i, dead);
+        }
+    }
+}
+
+/*
+ * Remove writes to globals that are overwritten before being read, even
+ * when the overwriting happens in another basic block of the TB.  This
+ * mostly catches flags that guests such as ARM compute eagerly into
+ * separate globals.  The liveness pass in tcg.c only removes such writes
+ * within a basic block, because it assumes that all globals are live at
+ * every branch.
+ *
+ * Walk the ops backwards, tracking the set of globals whose current value
+ * is certainly overwritten before it can be observed.  A global value can
+ * be observed by an op using it, by helpers that read globals, by host
+ * loads and stores to the memory backing it, and by anything that can
+ * leave the TB: exits, and ops that can raise an exception.  The set at
+ * each label is recorded so that forward branches can take the
+ * intersection with their fall-through path.  Backward branches are rare
+ * in a TB and are handled conservatively.
+ */
+static void tcg_optimize_dead_globals(TCGContext *s)
+{
+    int nb_globals = s->nb_globals;
+    size_t nb_longs = BITS_TO_LONGS(nb_globals);
+    unsigned long *dead, **label_dead;
+    TCGOp *op, *op_prev;
+
+    if (nb_globals == 0) {
+        return;
+    }
+    dead = tcg_malloc(nb_longs * sizeof(unsigned long));
+    label_dead = tcg_malloc(s->nb_labels * sizeof(unsigned long *));
+    memset(label_dead, 0, s->nb_labels * sizeof(unsigned long *));
+    bitmap_zero(dead, nb_globals);
+
+    QTAILQ_FOREACH_REVERSE_SAFE(op, &s->ops, TCGOpHead, link, op_prev) {
+        TCGOpcode opc = op->opc;
+        const TCGOpDef *def = &tcg_op_defs[opc];
+        int nb_oargs, nb_iargs, mem_size, i;
+        TCGLabel *l;
+
+        switch (opc) {
+        case INDEX_op_set_label:
+            l = arg_label(op->args[0]);
+            label_dead[l->id] = tcg_malloc(nb_longs * sizeof(unsigned long));
+            bitmap_copy(label_dead[l->id], dead, nb_globals);
+            continue;
+        case INDEX_op_br:
+            l = arg_label(op->args[0]);
+            if (label_dead[l->id]) {
+                bitmap_copy(dead, label_dead[l->id], nb_globals);
+            } else {
+                bitmap_zero(dead, nb_globals);
+            }
+            continue;
+        case INDEX_op_insn_start:
+        case INDEX_op_discard:
+            continue;
+        case INDEX_op_call:
+            nb_oargs = TCGOP_CALLO(op);
+            nb_iargs = TCGOP_CALLI(op);
+            for (i = 0; i < nb_oargs; i++) {
+                TCGTemp *ts = arg_temp(op->args[i]);
+
+                if (temp_idx(ts) < nb_globals) {
+                    set_bit(temp_idx(ts), dead);
+                }
+            }
+            if (!(op->args[nb_oargs + nb_iargs + 1] &
+                  TCG_CALL_NO_READ_GLOBALS)) {
+                bitmap_zero(dead, nb_globals);
+            }
+            for (i = nb_oargs; i < nb_oargs + nb_iargs; i++) {
+                TCGTemp *ts = arg_temp(op->args[i]);
+
+                if (ts) {
+                    dead_globals_use(dead, ts, nb_globals);
+                }
+            }
+            continue;
+        default:
+            break;
+        }
+
+        nb_oargs = def->nb_oargs;
+        nb_iargs = def->nb_iargs;
+
+        if (nb_oargs &&
+            !(def->flags & (TCG_OPF_BB_END | TCG_OPF_SIDE_EFFECTS))) {
+            bool removable = true;
+
+            for (i = 0; i < nb_oargs; i++) {
+                TCGTemp *ts = arg_temp(op->args[i]);
+                size_t idx = temp_idx(ts);
+
+                if (idx >= nb_globals || ts->fixed_reg ||
+                    !test_bit(idx, dead)) {
+                    removable = false;
+                    break;
+                }
+            }
+            if (removable) {
+                tcg_op_remove(s, op);
+                continue;
+            }
+        }
+
+        for (i = 0; i < nb_oargs; i++) {
+            TCGTemp *ts = arg_temp(op->args[i]);
+            size_t idx = temp_idx(ts);
+
+            if (idx < nb_globals) {
+                set_bit(idx, dead);
+                if (ts->indirect_reg) {
+                    clear_bit(temp_idx(ts->mem_base), dead);
+                }
+            }
+        }
+
+        if (def->flags & TCG_OPF_BB_END) {
+            /* conditional branches; everything else leaves the TB */
+            l = NULL;
+            if (opc == INDEX_op_brcond_i32 || opc == INDEX_op_brcond_i64 ||
+                opc == INDEX_op_brcond2_i32) {
+                l = arg_label(op->args[nb_iargs + def->nb_cargs - 1]);
+            }
+            if (l && label_dead[l->id]) {
+                bitmap_and(dead, dead, label_dead[l->id], nb_globals);
+            } else {
+                bitmap_zero(dead, nb_globals);
+            }
+        } else if (def->flags & TCG_OPF_SIDE_EFFECTS) {
+            /* may raise an exception, which observes all globals */
+            bitmap_zero(dead, nb_globals);
+        }
+
+        mem_size = dead_globals_mem_size(op);
+        if (mem_size) {
+            dead_globals_use_mem(s, dead, arg_temp(op->args[1]),
+                                 op->args[2], mem_size);
+        }
+        for (i = nb_oargs; i < nb_oargs + nb_iargs; i++) {
+            dead_globals_use(dead, arg_temp(op->args[i]), nb_globals);
+        }
+    }
+}
+
 /* Propagate constants and copies, fold constant expressions. */
 void tcg_optimize(TCGContext *s)
 {
@@ -1502,4 +1721,6 @@ void tcg_optimize(TCGContext *s)
             prev_mb = op;
         }
     }
+
+    tcg_optimize_dead_globals(s);
 }
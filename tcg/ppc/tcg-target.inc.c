@@ -2783,6 +2783,12 @@ static const TCGTargetOpDef *tcg_target_op_def(TCGOpcode op)
     }
 }
 
+/* Host features the code generated by this backend depends on */
+static uint64_t tcg_target_feature_mask(void)
+{
+    return (uint64_t)have_isa_2_06 | (uint64_t)have_isa_3_00 << 1;
+}
+
 static void tcg_target_init(TCGContext *s)
 {
     unsigned long hwcap = qemu_getauxval(AT_HWCAP);
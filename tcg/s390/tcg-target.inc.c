@@ -2495,6 +2495,12 @@ static void query_s390_facilities(void)
     }
 }
 
+/* Host features the code generated by this backend depends on */
+static uint64_t tcg_target_feature_mask(void)
+{
+    return s390_facilities;
+}
+
 static void tcg_target_init(TCGContext *s)
 {
     query_s390_facilities();
@@ -34,6 +34,7 @@
 #include "qemu/cutils.h"
 #include "qemu/host-utils.h"
 #include "qemu/timer.h"
+#include "qemu/bitmap.h"
 
 /* Note: the long term plan is to reduce the dependencies on the QEMU
    CPU definitions. Currently they are used for qemu_ld/st
@@ -66,6 +67,7 @@
 static void tcg_target_init(TCGContext *s);
 static const TCGTargetOpDef *tcg_target_op_def(TCGOpcode);
 static void tcg_target_qemu_prologue(TCGContext *s);
+static uint64_t tcg_target_feature_mask(void);
 static void patch_reloc(tcg_insn_unit *code_ptr, int type,
                         intptr_t value, intptr_t addend);
 
@@ -162,6 +164,11 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    unsigned long *evicted; /* regions below .current that are free again */
+    size_t clock_hand; /* next region considered for eviction */
+
+    /* regions with TBs looked up since the hand last passed; atomic */
+    unsigned long *used;
 };
 
 static struct tcg_region_state region;
@@ -373,22 +380,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(void *p)
+static size_t tc_ptr_to_region_idx(const void *p)
 {
-    size_t region_idx;
-
     if (p < region.start_aligned) {
-        region_idx = 0;
+        return 0;
     } else {
         ptrdiff_t offset = p - region.start_aligned;
 
         if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
+            return region.n - 1;
         }
+        return offset / region.stride;
     }
-    return region_trees + region_idx * tree_size;
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(void *p)
+{
+    return region_trees + tc_ptr_to_region_idx(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -523,8 +531,16 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
+    size_t i;
+
     if (region.current == region.n) {
-        return true;
+        i = find_first_bit(region.evicted, region.n);
+        if (i == region.n) {
+            return true;
+        }
+        clear_bit(i, region.evicted);
+        tcg_region_assign(s, i);
+        return false;
     }
     tcg_region_assign(s, region.current);
     region.current++;
@@ -568,6 +584,9 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.clock_hand = 0;
+    bitmap_zero(region.evicted, region.n);
+    bitmap_zero(region.used, region.n);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = atomic_read(&tcg_ctxs[i]);
@@ -580,6 +599,131 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+/*
+ * Note that the TB whose code starts at @tc_ptr has been looked up, so
+ * that its region is not the next one to be evicted.
+ */
+void tcg_region_mark_used(const void *tc_ptr)
+{
+    size_t i = tc_ptr_to_region_idx(tc_ptr);
+
+    if (!test_bit(i, region.used)) {
+        set_bit_atomic(i, region.used);
+    }
+}
+
+/* Returns true if a TCG context can get a new region without an eviction */
+bool tcg_region_available(void)
+{
+    bool ret;
+
+    qemu_mutex_lock(&region.lock);
+    ret = region.current < region.n ||
+          find_first_bit(region.evicted, region.n) < region.n;
+    qemu_mutex_unlock(&region.lock);
+    return ret;
+}
+
+static bool tcg_region_evictable__locked(size_t i)
+{
+    unsigned int n_ctxs = atomic_read(&n_tcg_ctxs);
+    void *start, *end;
+    unsigned int j;
+
+    if (i >= region.current || test_bit(i, region.evicted)) {
+        return false;
+    }
+    tcg_region_bounds(i, &start, &end);
+    for (j = 0; j < n_ctxs; j++) {
+        if (atomic_read(&tcg_ctxs[j])->code_gen_buffer == start) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Pick the region to evict with the clock algorithm: regions that had a
+ * TB looked up since the hand last went past them get a second chance.
+ * Regions being filled by a TCG context are never picked.
+ */
+static bool tcg_region_pick_victim__locked(size_t *victim)
+{
+    size_t k;
+
+    for (k = 0; k < 2 * region.n; k++) {
+        size_t i = region.clock_hand;
+
+        region.clock_hand = (i + 1) % region.n;
+        if (!tcg_region_evictable__locked(i)) {
+            continue;
+        }
+        if (test_bit(i, region.used)) {
+            clear_bit(i, region.used);
+            continue;
+        }
+        *victim = i;
+        return true;
+    }
+    return false;
+}
+
+static gboolean tcg_region_collect_tb(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return false;
+}
+
+/*
+ * Free the least recently used region that no TCG context is filling.
+ * @invalidate is called on each of the region's TBs first and must make
+ * them unreachable, i.e. remove them from the lookup structures and
+ * unlink any jump to them.  Returns false if no region could be evicted.
+ *
+ * Call from a safe-work context.
+ */
+bool tcg_region_evict(void (*invalidate)(TranslationBlock *tb))
+{
+    struct tcg_region_tree *rt;
+    GPtrArray *tbs;
+    void *start, *end;
+    size_t victim;
+    guint i;
+
+    qemu_mutex_lock(&region.lock);
+    if (!tcg_region_pick_victim__locked(&victim)) {
+        qemu_mutex_unlock(&region.lock);
+        return false;
+    }
+    qemu_mutex_unlock(&region.lock);
+
+    rt = region_trees + victim * tree_size;
+    tbs = g_ptr_array_new();
+    qemu_mutex_lock(&rt->lock);
+    g_tree_foreach(rt->tree, tcg_region_collect_tb, tbs);
+    qemu_mutex_unlock(&rt->lock);
+
+    for (i = 0; i < tbs->len; i++) {
+        invalidate(g_ptr_array_index(tbs, i));
+    }
+    g_ptr_array_free(tbs, true);
+
+    qemu_mutex_lock(&rt->lock);
+    /* Increment the refcount first so that destroy acts as a reset */
+    g_tree_ref(rt->tree);
+    g_tree_destroy(rt->tree);
+    qemu_mutex_unlock(&rt->lock);
+
+    tcg_region_bounds(victim, &start, &end);
+    qemu_mutex_lock(&region.lock);
+    set_bit(victim, region.evicted);
+    clear_bit(victim, region.used);
+    region.agg_size_full -= end - start - TCG_HIGHWATER;
+    qemu_mutex_unlock(&region.lock);
+    return true;
+}
+
 #ifdef CONFIG_USER_ONLY
 static size_t tcg_n_regions(void)
 {
@@ -588,33 +732,39 @@ static size_t tcg_n_regions(void)
 #else
 /*
  * It is likely that some vCPUs will translate more code than others, so we
- * first try to set more regions than max_cpus, with those regions being of
+ * first try to set more regions than TCG threads, with those regions being of
  * reasonable size. If that's not possible we make do by evenly dividing
- * the code_gen_buffer among the vCPUs.
+ * the code_gen_buffer among the threads.
+ *
+ * Having more regions than threads also lets tb_gen_code() evict the
+ * least recently used region when the buffer fills up, instead of
+ * flushing everything; see tcg_region_evict().
  */
 static size_t tcg_n_regions(void)
 {
+    size_t n_threads;
     size_t i;
 
-    /* Use a single region if all we have is one vCPU thread */
     if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
+        n_threads = 1;
+    } else {
+        n_threads = max_cpus;
     }
 
-    /* Try to have more regions than max_cpus, with each region being >= 2 MB */
+    /* Try to have more regions than threads, with each region being >= 2 MB */
     for (i = 8; i > 0; i--) {
         size_t regions_per_thread = i;
         size_t region_size;
 
         region_size = tcg_init_ctx.code_gen_buffer_size;
-        region_size /= max_cpus * regions_per_thread;
+        region_size /= n_threads * regions_per_thread;
 
         if (region_size >= 2 * 1024u * 1024) {
-            return max_cpus * regions_per_thread;
+            return n_threads * regions_per_thread;
         }
     }
-    /* If we can't, then just allocate one region per vCPU thread */
-    return max_cpus;
+    /* If we can't, then just allocate one region per thread */
+    return n_threads;
 }
 #endif
 
@@ -629,7 +779,9 @@ static size_t tcg_n_regions(void)
  * code in parallel without synchronization.
  *
  * In softmmu the number of TCG threads is bounded by max_cpus, so we use at
- * least max_cpus regions in MTTCG. In !MTTCG we use a single region.
+ * least max_cpus regions in MTTCG. In !MTTCG there is a single TCG thread,
+ * which still gets several regions when the buffer is large enough, so
+ * that they can be evicted one at a time.
  * Note that the TCG options from the command-line (i.e. -accel accel=tcg,[...])
  * must have been parsed before calling this function, since it calls
  * qemu_tcg_mttcg_enabled().
@@ -683,6 +835,8 @@ void tcg_region_init(void)
     region.end = QEMU_ALIGN_PTR_DOWN(buf + size, page_size);
     /* account for that last guard page */
     region.end -= page_size;
+    region.evicted = bitmap_new(region.n);
+    region.used = bitmap_new(region.n);
 
     /* set guard pages */
     for (i = 0; i < region.n; i++) {
@@ -814,6 +968,50 @@ size_t tcg_tb_phys_invalidate_count(void)
     return total;
 }
 
+/*
+ * Bump whenever a change to this file or to a backend makes the code
+ * generated for the same ops incompatible with what was emitted before.
+ */
+#define TCG_BACKEND_VERSION 1
+
+/*
+ * Return the host features that the backend chose to use when it was
+ * initialized.  Code generated with a feature may not run without it.
+ */
+uint64_t tcg_backend_features(void)
+{
+    return tcg_target_feature_mask();
+}
+
+/*
+ * Return a string that identifies the host code generated by this process.
+ * Two processes with the same identifier emit interchangeable code: the
+ * backend, the host features it uses, its prologue and its placement in
+ * memory, as well as the QEMU image providing the helpers, are all the
+ * same.
+ */
+char *tcg_backend_id(void)
+{
+    const TCGContext *s = tcg_ctx;
+    uint64_t data[] = {
+        TCG_BACKEND_VERSION,
+        tcg_backend_features(),
+        (uintptr_t)s->code_gen_prologue,
+        (uintptr_t)s->code_gen_epilogue,
+        (uintptr_t)&tcg_gen_code,
+        (uintptr_t)&tcg_init_ctx,
+    };
+    GChecksum *cs = g_checksum_new(G_CHECKSUM_SHA256);
+    char *id;
+
+    g_checksum_update(cs, (const guchar *)data, sizeof(data));
+    g_checksum_update(cs, (const guchar *)s->code_gen_prologue,
+                      s->code_gen_buffer - s->code_gen_prologue);
+    id = g_strdup(g_checksum_get_string(cs));
+    g_checksum_free(cs);
+    return id;
+}
+
 /* pool based memory allocation */
 void *tcg_malloc_internal(TCGContext *s, int size)
 {
@@ -1083,6 +1281,8 @@ void tcg_func_start(TCGContext *s)
     s->nb_ops = 0;
     s->nb_labels = 0;
     s->current_frame_offset = s->frame_start;
+    s->tb_host_ptr = false;
+    s->goto_tb_dest_mask = 0;
 
 #ifdef CONFIG_DEBUG_TCG
     s->goto_tb_issue_mask = 0;
@@ -1605,6 +1805,16 @@ bool tcg_op_supported(TCGOpcode op)
     case INDEX_op_shrv_vec:
     case INDEX_op_sarv_vec:
         return have_vec && TCG_TARGET_HAS_shv_vec;
+    case INDEX_op_ssadd_vec:
+    case INDEX_op_usadd_vec:
+    case INDEX_op_sssub_vec:
+    case INDEX_op_ussub_vec:
+        return have_vec && TCG_TARGET_HAS_sat_vec;
+    case INDEX_op_smin_vec:
+    case INDEX_op_umin_vec:
+    case INDEX_op_smax_vec:
+    case INDEX_op_umax_vec:
+        return have_vec && TCG_TARGET_HAS_minmax_vec;
 
     default:
         tcg_debug_assert(op > INDEX_op_last_generic && op < NB_OPS);
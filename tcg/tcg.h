@@ -183,6 +183,8 @@ typedef uint64_t TCGRegSet;
 #define TCG_TARGET_HAS_shs_vec          0
 #define TCG_TARGET_HAS_shv_vec          0
 #define TCG_TARGET_HAS_mul_vec          0
+#define TCG_TARGET_HAS_sat_vec          0
+#define TCG_TARGET_HAS_minmax_vec       0
 #else
 #define TCG_TARGET_MAYBE_vec            1
 #endif
@@ -667,6 +669,11 @@ struct TCGContext {
 
     TCGRegSet reserved_regs;
     uint32_t tb_cflags; /* cflags of the current TB */
+    /* The current TB embeds a host pointer outside of code_gen_buffer */
+    bool tb_host_ptr;
+    /* Direct jump destinations noted by the front end, by goto_tb slot */
+    unsigned int goto_tb_dest_mask;
+    target_ulong goto_tb_dest[2];
     intptr_t current_frame_offset;
     intptr_t frame_start;
     intptr_t frame_end;
@@ -868,6 +875,9 @@ TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_init(void);
 void tcg_region_reset_all(void);
+void tcg_region_mark_used(const void *tc_ptr);
+bool tcg_region_available(void);
+bool tcg_region_evict(void (*invalidate)(TranslationBlock *tb));
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -875,6 +885,8 @@ size_t tcg_code_capacity(void);
 void tcg_tb_insert(TranslationBlock *tb);
 void tcg_tb_remove(TranslationBlock *tb);
 size_t tcg_tb_phys_invalidate_count(void);
+uint64_t tcg_backend_features(void);
+char *tcg_backend_id(void);
 TranslationBlock *tcg_tb_lookup(uintptr_t tc_ptr);
 void tcg_tb_foreach(GTraverseFunc func, gpointer user_data);
 size_t tcg_nb_tbs(void);
@@ -1090,12 +1102,27 @@ TCGv_vec tcg_const_ones_vec(TCGType);
 TCGv_vec tcg_const_zeros_vec_matching(TCGv_vec);
 TCGv_vec tcg_const_ones_vec_matching(TCGv_vec);
 
+/*
+ * Host pointers baked into the generated code tie it to this process,
+ * except for those into code_gen_buffer, which is saved along with it.
+ */
+static inline intptr_t tcg_host_ptr(const void *p)
+{
+    TCGContext *s = tcg_ctx;
+
+    if (p && ((void *)p < s->code_gen_buffer ||
+              (void *)p >= s->code_gen_buffer + s->code_gen_buffer_size)) {
+        s->tb_host_ptr = true;
+    }
+    return (intptr_t)p;
+}
+
 #if UINTPTR_MAX == UINT32_MAX
-# define tcg_const_ptr(x)        ((TCGv_ptr)tcg_const_i32((intptr_t)(x)))
-# define tcg_const_local_ptr(x)  ((TCGv_ptr)tcg_const_local_i32((intptr_t)(x)))
+# define tcg_const_ptr(x)        ((TCGv_ptr)tcg_const_i32(tcg_host_ptr(x)))
+# define tcg_const_local_ptr(x)  ((TCGv_ptr)tcg_const_local_i32(tcg_host_ptr(x)))
 #else
-# define tcg_const_ptr(x)        ((TCGv_ptr)tcg_const_i64((intptr_t)(x)))
-# define tcg_const_local_ptr(x)  ((TCGv_ptr)tcg_const_local_i64((intptr_t)(x)))
+# define tcg_const_ptr(x)        ((TCGv_ptr)tcg_const_i64(tcg_host_ptr(x)))
+# define tcg_const_local_ptr(x)  ((TCGv_ptr)tcg_const_local_i64(tcg_host_ptr(x)))
 #endif
 
 TCGLabel *gen_new_label(void);
@@ -859,6 +859,12 @@ static int tcg_target_const_match(tcg_target_long val, TCGType type,
     return arg_ct->ct & TCG_CT_CONST;
 }
 
+/* The interpreter does not depend on host features */
+static uint64_t tcg_target_feature_mask(void)
+{
+    return 0;
+}
+
 static void tcg_target_init(TCGContext *s)
 {
 #if defined(CONFIG_DEBUG_TCG_INTERPRETER)
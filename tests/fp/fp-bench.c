@@ -0,0 +1,429 @@
+/*
+ * fp-bench.c - A collection of simple floating point microbenchmarks.
+ *
+ * Compares QEMU's softfloat (with its host-FPU fast path) against the
+ * host's native floating point operations.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#ifndef HW_POISON_H
+#error Must define HW_POISON_H to work around TARGET_* poisoning
+#endif
+
+#include "qemu/osdep.h"
+#include <math.h>
+#include <fenv.h>
+#include "qemu/timer.h"
+#include "fpu/softfloat.h"
+
+/* amortize the computation of random inputs */
+#define OPS_PER_ITER     50000
+
+#define MAX_OPERANDS 3
+
+#define SEED_A 0xdeadfacedeadface
+#define SEED_B 0xbadc0feebadc0fee
+#define SEED_C 0xbeefdeadbeefdead
+
+enum op {
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_FMA,
+    OP_SQRT,
+};
+
+static const char * const op_names[] = {
+    [OP_ADD] = "add",
+    [OP_SUB] = "sub",
+    [OP_MUL] = "mul",
+    [OP_DIV] = "div",
+    [OP_FMA] = "mulAdd",
+    [OP_SQRT] = "sqrt",
+};
+
+enum precision {
+    PREC_SINGLE,
+    PREC_DOUBLE,
+    PREC_FLOAT32,
+    PREC_FLOAT64,
+};
+
+static const char * const prec_names[] = {
+    [PREC_SINGLE] = "single",
+    [PREC_DOUBLE] = "double",
+    [PREC_FLOAT32] = "float32",
+    [PREC_FLOAT64] = "float64",
+};
+
+enum rounding {
+    ROUND_EVEN,
+    ROUND_ZERO,
+};
+
+static const char * const round_names[] = {
+    [ROUND_EVEN] = "even",
+    [ROUND_ZERO] = "zero",
+};
+
+union fp {
+    float f;
+    double d;
+    float32 f32;
+    float64 f64;
+    uint64_t u64;
+};
+
+static float_status soft_status;
+static enum precision precision;
+static enum op operation;
+static enum rounding round_mode;
+static uint64_t n_completed_ops;
+static unsigned int duration = 1;
+static uint64_t random_seeds[MAX_OPERANDS];
+static uint64_t seed_a = SEED_A;
+static uint64_t seed_b = SEED_B;
+static uint64_t seed_c = SEED_C;
+
+/* xorshift64star; the inputs only need to be reasonably spread */
+static inline uint64_t xorshift64star(uint64_t x)
+{
+    x ^= x >> 12; /* a */
+    x ^= x << 25; /* b */
+    x ^= x >> 27; /* c */
+    return x * UINT64_C(2685821657736338717);
+}
+
+static void update_random_ops(int n_ops, enum precision prec)
+{
+    int i;
+
+    for (i = 0; i < n_ops; i++) {
+        uint64_t r = random_seeds[i];
+
+        switch (prec) {
+        case PREC_SINGLE:
+        case PREC_FLOAT32:
+            do {
+                r = xorshift64star(r);
+            } while (!float32_is_normal(make_float32(r)));
+            break;
+        case PREC_DOUBLE:
+        case PREC_FLOAT64:
+            do {
+                r = xorshift64star(r);
+            } while (!float64_is_normal(make_float64(r)));
+            break;
+        default:
+            g_assert_not_reached();
+        }
+        random_seeds[i] = r;
+    }
+}
+
+static void fill_random(union fp *ops, int n_ops, enum precision prec,
+                        bool no_neg)
+{
+    int i;
+
+    for (i = 0; i < n_ops; i++) {
+        uint64_t r = random_seeds[i];
+
+        switch (prec) {
+        case PREC_SINGLE:
+        case PREC_FLOAT32:
+            ops[i].f32 = make_float32(r);
+            if (no_neg && float32_is_neg(ops[i].f32)) {
+                ops[i].f32 = float32_chs(ops[i].f32);
+            }
+            break;
+        case PREC_DOUBLE:
+        case PREC_FLOAT64:
+            ops[i].f64 = make_float64(r);
+            if (no_neg && float64_is_neg(ops[i].f64)) {
+                ops[i].f64 = float64_chs(ops[i].f64);
+            }
+            break;
+        default:
+            g_assert_not_reached();
+        }
+    }
+}
+
+/*
+ * The main benchmark function. Instead of (ab)using macros, we rely
+ * on the compiler to unfold this at compile-time.
+ */
+static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
+{
+    int64_t tf = get_clock() + duration * 1000000000LL;
+
+    while (get_clock() < tf) {
+        union fp ops[MAX_OPERANDS];
+        int i;
+
+        update_random_ops(n_ops, prec);
+        switch (prec) {
+        case PREC_SINGLE:
+            fill_random(ops, n_ops, prec, no_neg);
+            for (i = 0; i < OPS_PER_ITER; i++) {
+                float a = ops[0].f;
+                float b = ops[1].f;
+                float c = ops[2].f;
+
+                switch (op) {
+                case OP_ADD:
+                    ops[0].f = a + b;
+                    break;
+                case OP_SUB:
+                    ops[0].f = a - b;
+                    break;
+                case OP_MUL:
+                    ops[0].f = a * b;
+                    break;
+                case OP_DIV:
+                    ops[0].f = a / b;
+                    break;
+                case OP_FMA:
+                    ops[0].f = fmaf(a, b, c);
+                    break;
+                case OP_SQRT:
+                    ops[0].f = sqrtf(a);
+                    break;
+                default:
+                    g_assert_not_reached();
+                }
+            }
+            break;
+        case PREC_DOUBLE:
+            fill_random(ops, n_ops, prec, no_neg);
+            for (i = 0; i < OPS_PER_ITER; i++) {
+                double a = ops[0].d;
+                double b = ops[1].d;
+                double c = ops[2].d;
+
+                switch (op) {
+                case OP_ADD:
+                    ops[0].d = a + b;
+                    break;
+                case OP_SUB:
+                    ops[0].d = a - b;
+                    break;
+                case OP_MUL:
+                    ops[0].d = a * b;
+                    break;
+                case OP_DIV:
+                    ops[0].d = a / b;
+                    break;
+                case OP_FMA:
+                    ops[0].d = fma(a, b, c);
+                    break;
+                case OP_SQRT:
+                    ops[0].d = sqrt(a);
+                    break;
+                default:
+                    g_assert_not_reached();
+                }
+            }
+            break;
+        case PREC_FLOAT32:
+            fill_random(ops, n_ops, prec, no_neg);
+            for (i = 0; i < OPS_PER_ITER; i++) {
+                float32 a = ops[0].f32;
+                float32 b = ops[1].f32;
+                float32 c = ops[2].f32;
+
+                switch (op) {
+                case OP_ADD:
+                    ops[0].f32 = float32_add(a, b, &soft_status);
+                    break;
+                case OP_SUB:
+                    ops[0].f32 = float32_sub(a, b, &soft_status);
+                    break;
+                case OP_MUL:
+                    ops[0].f32 = float32_mul(a, b, &soft_status);
+                    break;
+                case OP_DIV:
+                    ops[0].f32 = float32_div(a, b, &soft_status);
+                    break;
+                case OP_FMA:
+                    ops[0].f32 = float32_muladd(a, b, c, 0, &soft_status);
+                    break;
+                case OP_SQRT:
+                    ops[0].f32 = float32_sqrt(a, &soft_status);
+                    break;
+                default:
+                    g_assert_not_reached();
+                }
+            }
+            break;
+        case PREC_FLOAT64:
+            fill_random(ops, n_ops, prec, no_neg);
+            for (i = 0; i < OPS_PER_ITER; i++) {
+                float64 a = ops[0].f64;
+                float64 b = ops[1].f64;
+                float64 c = ops[2].f64;
+
+                switch (op) {
+                case OP_ADD:
+                    ops[0].f64 = float64_add(a, b, &soft_status);
+                    break;
+                case OP_SUB:
+                    ops[0].f64 = float64_sub(a, b, &soft_status);
+                    break;
+                case OP_MUL:
+                    ops[0].f64 = float64_mul(a, b, &soft_status);
+                    break;
+                case OP_DIV:
+                    ops[0].f64 = float64_div(a, b, &soft_status);
+                    break;
+                case OP_FMA:
+                    ops[0].f64 = float64_muladd(a, b, c, 0, &soft_status);
+                    break;
+                case OP_SQRT:
+                    ops[0].f64 = float64_sqrt(a, &soft_status);
+                    break;
+                default:
+                    g_assert_not_reached();
+                }
+            }
+            break;
+        default:
+            g_assert_not_reached();
+        }
+        n_completed_ops += OPS_PER_ITER;
+    }
+}
+
+static void run_bench(void)
+{
+    int n_ops;
+
+    switch (operation) {
+    case OP_FMA:
+        n_ops = 3;
+        break;
+    case OP_SQRT:
+        n_ops = 1;
+        break;
+    default:
+        n_ops = 2;
+        break;
+    }
+
+    random_seeds[0] = seed_a;
+    random_seeds[1] = seed_b;
+    random_seeds[2] = seed_c;
+
+    bench(precision, operation, n_ops, operation == OP_SQRT);
+}
+
+static int find_name(const char * const *tbl, size_t n, const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (tbl[i] && !strcmp(tbl[i], name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void usage_complete(int argc, char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, " -d = duration, in seconds. Default: %u\n", duration);
+    fprintf(stderr, " -h = show this help message.\n");
+    fprintf(stderr, " -o = floating point operation (add, sub, mul, div, "
+            "mulAdd, sqrt). Default: %s\n", op_names[0]);
+    fprintf(stderr, " -p = floating point precision (single, double, "
+            "float32, float64). Default: %s\n", prec_names[0]);
+    fprintf(stderr, " -r = rounding mode (even, zero). Default: %s\n",
+            round_names[0]);
+    fprintf(stderr, " -z = flush inputs to zero (soft-fp only).\n");
+    fprintf(stderr, "\nThe host FPU fast path in float32/float64 is taken "
+            "only with -r even,\nsince the inexact flag is pre-set here.\n");
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+    int val;
+
+    for (;;) {
+        c = getopt(argc, argv, "d:ho:p:r:z");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'h':
+            usage_complete(argc, argv);
+            exit(EXIT_SUCCESS);
+        case 'o':
+            val = find_name(op_names, ARRAY_SIZE(op_names), optarg);
+            if (val < 0) {
+                fprintf(stderr, "Unsupported op '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            operation = val;
+            break;
+        case 'p':
+            val = find_name(prec_names, ARRAY_SIZE(prec_names), optarg);
+            if (val < 0) {
+                fprintf(stderr, "Unsupported precision '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            precision = val;
+            break;
+        case 'r':
+            val = find_name(round_names, ARRAY_SIZE(round_names), optarg);
+            if (val < 0) {
+                fprintf(stderr, "Unsupported rounding mode '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            round_mode = val;
+            break;
+        case 'z':
+            soft_status.flush_inputs_to_zero = 1;
+            break;
+        default:
+            /* invalid option or missing argument; getopt prints error info */
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void set_rounding_mode(void)
+{
+    switch (round_mode) {
+    case ROUND_EVEN:
+        soft_status.float_rounding_mode = float_round_nearest_even;
+        fesetround(FE_TONEAREST);
+        break;
+    case ROUND_ZERO:
+        soft_status.float_rounding_mode = float_round_to_zero;
+        fesetround(FE_TOWARDZERO);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+    set_rounding_mode();
+    /* guests rarely clear the inexact flag; mimic that */
+    soft_status.float_exception_flags = float_flag_inexact;
+
+    run_bench();
+    printf("%.2f MFlops\n", (double)n_completed_ops / duration / 1e6);
+    return 0;
+}
@@ -377,6 +377,17 @@ static void migrate_recover(QTestState *who, const char *uri)
     qobject_unref(rsp);
 }
 
+static void migrate_incoming(QTestState *who, const char *uri)
+{
+    QDict *rsp;
+
+    rsp = wait_command(who,
+                       "{ 'execute': 'migrate-incoming', "
+                       "  'arguments': { 'uri': %s } }",
+                       uri);
+    qobject_unref(rsp);
+}
+
 static void migrate_set_capability(QTestState *who, const char *capability,
                                    bool value)
 {
@@ -781,6 +792,42 @@ static void test_precopy_unix(void)
     g_free(uri);
 }
 
+static void test_precopy_file_fixed_ram(void)
+{
+    char *uri = g_strdup_printf("file:%s/migfile", tmpfs);
+    QTestState *from, *to;
+
+    if (test_migrate_start(&from, &to, "defer", false)) {
+        return;
+    }
+
+    migrate_set_capability(from, "fixed-ram", true);
+    migrate_set_capability(to, "fixed-ram", true);
+    migrate_set_parameter(from, "max-bandwidth", 1000000000);
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    /* Save a stopped guest, so the file is complete once we are done */
+    qobject_unref(wait_command(from, "{ 'execute' : 'stop'}"));
+
+    migrate(from, uri, "{}");
+    wait_for_migration_complete(from);
+
+    migrate_incoming(to, uri);
+    wait_for_migration_complete(to);
+
+    /* The source was paused, so the destination does not start by itself */
+    qobject_unref(wait_command(to, "{ 'execute' : 'cont'}"));
+    qtest_qmp_eventwait(to, "RESUME");
+
+    wait_for_serial("dest_serial");
+
+    test_migrate_end(from, to, true);
+    cleanup("migfile");
+    g_free(uri);
+}
+
 int main(int argc, char **argv)
 {
     char template[] = "/tmp/migration-test-XXXXXX";
@@ -832,6 +879,8 @@ int main(int argc, char **argv)
     qtest_add_func("/migration/deprecated", test_deprecated);
     qtest_add_func("/migration/bad_dest", test_baddest);
     qtest_add_func("/migration/precopy/unix", test_precopy_unix);
+    qtest_add_func("/migration/precopy/file/fixed-ram",
+                   test_precopy_file_fixed_ram);
 
     ret = g_test_run();
 
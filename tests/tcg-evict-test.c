@@ -0,0 +1,100 @@
+/*
+ * QTest testcase for TCG code buffer eviction
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+
+#define STUB_ADDR     0x8000
+#define COUNT_ADDR    0x9000
+
+/*
+ * Boot sector that keeps the translator busy: each iteration rewrites the
+ * immediate of a "mov $imm, %ax; ret" stub at STUB_ADDR, which invalidates
+ * its TB, calls the stub, and then counts the iteration at COUNT_ADDR.
+ * Every call translates a fresh TB, so the code buffer fills up and TCG
+ * has to evict regions while the loop itself stays hot.
+ */
+static const uint8_t boot_code[] = {
+    0xfa,                               /* 7c00: cli */
+    0x31, 0xc0,                         /* 7c01: xor %ax,%ax */
+    0x8e, 0xd8,                         /* 7c03: mov %ax,%ds */
+    0x8e, 0xd0,                         /* 7c05: mov %ax,%ss */
+    0xbc, 0x00, 0x60,                   /* 7c07: mov $0x6000,%sp */
+    0xc7, 0x06, 0x00, 0x80, 0xb8, 0x00, /* 7c0a: movw $0x00b8,0x8000 */
+    0xc7, 0x06, 0x02, 0x80, 0x00, 0xc3, /* 7c10: movw $0xc300,0x8002 */
+    0xff, 0x06, 0x01, 0x80,             /* 7c16: incw 0x8001 */
+    0xe8, 0xe3, 0x03,                   /* 7c1a: call 0x8000 */
+    0xff, 0x06, 0x00, 0x90,             /* 7c1d: incw 0x9000 */
+    0xeb, 0xf3,                         /* 7c21: jmp 7c16 */
+};
+
+static char disk[] = "tests/tcg-evict-disk-XXXXXX";
+
+/* Wait at most 600 seconds (test is slow with TCI and --enable-debug) */
+#define TEST_DELAY (1 * G_USEC_PER_SEC / 10)
+#define TEST_CYCLES MAX((600 * G_USEC_PER_SEC / TEST_DELAY), 1)
+
+static unsigned int evict_count(QTestState *s)
+{
+    char *info = qtest_hmp(s, "info jit");
+    const char *p = strstr(info, "TB evict count");
+    unsigned int count = 0;
+
+    g_assert(p);
+    g_assert_cmpint(sscanf(p, "TB evict count %u", &count), ==, 1);
+    g_free(info);
+    return count;
+}
+
+static void test_evict(void)
+{
+    QTestState *s;
+    uint16_t stub, iters;
+    int i;
+
+    s = qtest_initf("-machine accel=tcg -tb-size 8 "
+                     "-drive file=%s,format=raw", disk);
+
+    for (i = 0; i < TEST_CYCLES; i++) {
+        if (evict_count(s) >= 2) {
+            break;
+        }
+        g_usleep(TEST_DELAY);
+    }
+    g_assert_cmpuint(evict_count(s), >=, 2);
+
+    /* The loop must have kept running correctly across the evictions */
+    qobject_unref(qtest_qmp(s, "{ 'execute': 'stop' }"));
+    stub = qtest_readw(s, STUB_ADDR + 1);
+    iters = qtest_readw(s, COUNT_ADDR);
+    g_assert(stub == iters || stub == (uint16_t)(iters + 1));
+    g_assert_cmpuint(iters, !=, 0);
+
+    qtest_quit(s);
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t sector[512] = { 0 };
+    int fd, ret;
+
+    fd = mkstemp(disk);
+    g_assert(fd >= 0);
+    memcpy(sector, boot_code, sizeof(boot_code));
+    sector[510] = 0x55;
+    sector[511] = 0xaa;
+    g_assert(write(fd, sector, sizeof(sector)) == sizeof(sector));
+    close(fd);
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/tcg/evict", test_evict);
+    ret = g_test_run();
+
+    unlink(disk);
+    return ret;
+}
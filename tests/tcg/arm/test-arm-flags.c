@@ -0,0 +1,135 @@
+/*
+ * Check that condition flags survive across branches
+ *
+ * The TCG optimizer removes writes to NF/ZF/CF/VF that are overwritten
+ * before being read, even across basic blocks.  Each case below sets the
+ * flags, branches, and then reads them back on a path where they must
+ * still hold the value computed before the branch.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define NZCV_MASK 0xf0000000u
+
+static int errors;
+
+static void check(const char *name, uint32_t got, uint32_t expected)
+{
+    if ((got & NZCV_MASK) != (expected & NZCV_MASK)) {
+        printf("FAIL %s: NZCV %08x, expected %08x\n", name,
+               got & NZCV_MASK, expected & NZCV_MASK);
+        errors++;
+    }
+}
+
+/* Flags of CMP a, b, computed the slow way */
+static uint32_t cmp_flags(uint32_t a, uint32_t b)
+{
+    uint32_t r = a - b;
+    uint32_t f = 0;
+
+    f |= (r & 0x80000000u);                         /* N */
+    f |= (r == 0) << 30;                            /* Z */
+    f |= (a >= b) << 29;                            /* C */
+    f |= (((a ^ b) & (a ^ r)) >> 31) << 28;         /* V */
+    return f;
+}
+
+/*
+ * The ARM front end ends a TB at every branch, so the branches within a
+ * TB come from conditionally executed insns: these jump over the insn
+ * when its condition fails.
+ */
+
+/* Flags set, then overwritten and recomputed on one path only */
+static uint32_t cmp_then_recompute(uint32_t a, uint32_t b)
+{
+    uint32_t psr, tmp;
+
+    asm volatile(".syntax unified\n\t"
+                 "mov %[tmp], #0\n\t"
+                 "cmp %[a], %[b]\n\t"
+                 "addsne %[tmp], %[a], #1\n\t"
+                 "cmpne %[a], %[b]\n\t"
+                 "mrs %[psr], cpsr\n\t"
+                 : [psr] "=r" (psr), [tmp] "=&r" (tmp)
+                 : [a] "r" (a), [b] "r" (b)
+                 : "cc");
+    return psr;
+}
+
+/* Flags set, then partly overwritten on one path only */
+static uint32_t cmp_then_movs(uint32_t a, uint32_t b)
+{
+    uint32_t psr, tmp;
+
+    asm volatile(".syntax unified\n\t"
+                 "mov %[tmp], #1\n\t"
+                 "cmp %[a], %[b]\n\t"
+                 "movsls %[tmp], #0\n\t"
+                 "mrs %[psr], cpsr\n\t"
+                 : [psr] "=r" (psr), [tmp] "=&r" (tmp)
+                 : [a] "r" (a), [b] "r" (b)
+                 : "cc");
+    return psr;
+}
+
+/* Flags of cmp_then_movs(): MOVS only sets N and Z when it executes */
+static uint32_t movs_flags(uint32_t a, uint32_t b)
+{
+    uint32_t f = cmp_flags(a, b);
+
+    if (a <= b) {
+        f = (f & 0x30000000u) | (1u << 30);
+    }
+    return f;
+}
+
+/* Flags computed in a loop, read after its last iteration */
+static uint32_t loop_flags(uint32_t n, uint32_t a, uint32_t b)
+{
+    uint32_t psr;
+
+    asm volatile("1:\n\t"
+                 "cmp %[a], %[b]\n\t"
+                 "subs %[n], %[n], #1\n\t"
+                 "bne 1b\n\t"
+                 "cmp %[a], %[b]\n\t"
+                 "mrs %[psr], cpsr\n\t"
+                 : [psr] "=r" (psr), [n] "+r" (n)
+                 : [a] "r" (a), [b] "r" (b)
+                 : "cc");
+    return psr;
+}
+
+int main(void)
+{
+    static const uint32_t vals[] = {
+        0, 1, 2, 0x7fffffff, 0x80000000u, 0x80000001u, 0xfffffffeu,
+        0xffffffffu,
+    };
+    int n = sizeof(vals) / sizeof(vals[0]);
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+            uint32_t a = vals[i], b = vals[j];
+            uint32_t f = cmp_flags(a, b);
+
+            check("cmp_then_recompute", cmp_then_recompute(a, b), f);
+            check("cmp_then_movs", cmp_then_movs(a, b), movs_flags(a, b));
+            check("loop_flags", loop_flags(3, a, b), f);
+        }
+    }
+
+    if (errors) {
+        printf("%d errors\n", errors);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,42 @@
+#!/usr/bin/env python
+#
+# Make the TB cache files in a directory look like they were written on a
+# host with different CPU features, keeping them correctly authenticated.
+#
+# Usage: tb-cache-features.py <cache dir>
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+
+from __future__ import print_function
+import glob
+import hashlib
+import hmac
+import os
+import struct
+import sys
+
+# magic[8], version, nb_tbs, then host_features (see TBCacheHeader)
+FEATURES_OFFSET = 16
+MAC_LEN = 32
+
+def main(cache_dir):
+    with open(os.path.join(cache_dir, 'key'), 'rb') as f:
+        key = f.read()
+    files = glob.glob(os.path.join(cache_dir, '*.tbc'))
+    if not files:
+        print('no cache file in', cache_dir, file=sys.stderr)
+        return 1
+    for path in files:
+        with open(path, 'rb') as f:
+            data = bytearray(f.read())
+        features, = struct.unpack_from('=Q', data, FEATURES_OFFSET)
+        struct.pack_into('=Q', data, FEATURES_OFFSET, features ^ (1 << 63))
+        body = bytes(data[:-MAC_LEN])
+        data[-MAC_LEN:] = hmac.new(key, body, hashlib.sha256).digest()
+        with open(path, 'wb') as f:
+            f.write(data)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1]))
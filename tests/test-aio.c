@@ -876,6 +876,98 @@ static void test_queue_chaining(void)
     g_assert_cmpint(data_b.i, ==, data_b.max);
 }
 
+#ifndef _WIN32
+typedef struct {
+    EventNotifier e;
+    int polls;
+    bool ready;
+} PollTestData;
+
+static bool busy_poll(void *opaque)
+{
+    return true;
+}
+
+static bool idle_poll(void *opaque)
+{
+    PollTestData *data = container_of(opaque, PollTestData, e);
+    bool ready = data->ready;
+
+    data->polls++;
+    data->ready = false;
+    return ready;
+}
+
+static bool poll_handler_idle(EventNotifier *e)
+{
+    AioPollHandlerStats *stats;
+    unsigned int i, count;
+    bool idle = false;
+    bool found = false;
+
+    stats = aio_context_get_poll_stats(ctx, &count);
+    for (i = 0; i < count; i++) {
+        if (stats[i].fd == event_notifier_get_fd(e)) {
+            idle = stats[i].idle;
+            found = true;
+        }
+    }
+    g_free(stats);
+    g_assert(found);
+    return idle;
+}
+
+static void test_poll_idle_handler(void)
+{
+    PollTestData busy = { .polls = 0 };
+    PollTestData idle = { .polls = 0 };
+    int polls;
+    int i;
+
+    event_notifier_init(&busy.e, false);
+    event_notifier_init(&idle.e, false);
+    aio_set_event_notifier(ctx, &busy.e, false, dummy_io_handler_read,
+                           busy_poll);
+    aio_set_event_notifier(ctx, &idle.e, false, dummy_io_handler_read,
+                           idle_poll);
+    aio_context_set_poll_params(ctx, NANOSECONDS_PER_SECOND, 0, 0,
+                                &error_abort);
+
+    /* The busy handler ends every polling window, so aio_poll() never
+     * blocks; after enough windows without work the other one is idle.
+     */
+    for (i = 0; i < 100; i++) {
+        g_assert(aio_poll(ctx, true));
+    }
+    g_assert(poll_handler_idle(&idle.e));
+    g_assert(!poll_handler_idle(&busy.e));
+
+    /* It is now left out of most polling windows */
+    polls = idle.polls;
+    for (i = 0; i < 64; i++) {
+        g_assert(aio_poll(ctx, true));
+    }
+    g_assert_cmpint(idle.polls - polls, <, 64 / 4);
+
+    /* Even though aio_poll() never looks at its file descriptor, work
+     * for the idle handler is found and brings it back into busy polling.
+     */
+    idle.ready = true;
+    event_notifier_set(&idle.e);
+    for (i = 0; i < 64 && idle.ready; i++) {
+        g_assert(aio_poll(ctx, true));
+    }
+    g_assert(!idle.ready);
+    g_assert(!poll_handler_idle(&idle.e));
+
+    aio_context_set_poll_params(ctx, 0, 0, 0, &error_abort);
+    set_event_notifier(ctx, &busy.e, NULL);
+    set_event_notifier(ctx, &idle.e, NULL);
+    event_notifier_cleanup(&busy.e);
+    event_notifier_cleanup(&idle.e);
+}
+#endif
+
 /* End of tests.  */
 
 int main(int argc, char **argv)
@@ -900,6 +992,9 @@ int main(int argc, char **argv)
     g_test_add_func("/aio/event/flush",             test_flush_event_notifier);
     g_test_add_func("/aio/external-client",         test_aio_external_client);
     g_test_add_func("/aio/timer/schedule",          test_timer_schedule);
+#ifndef _WIN32
+    g_test_add_func("/aio/poll/idle-handler",       test_poll_idle_handler);
+#endif
 
     g_test_add_func("/aio/coroutine/queue-chaining", test_queue_chaining);
 
@@ -292,6 +292,71 @@ static void test_lifecycle(void)
     g_assert(done); /* expect done to be true (second time) */
 }
 
+/*
+ * Check that the pool statistics account for every creation
+ */
+
+static void test_pool_stats(void)
+{
+    CoroutinePoolStats before, after;
+    Coroutine *coroutine;
+    bool done;
+    int i;
+
+    qemu_coroutine_get_pool_stats(&before);
+    for (i = 0; i < 100; i++) {
+        done = false;
+        coroutine = qemu_coroutine_create(set_and_exit, &done);
+        qemu_coroutine_enter(coroutine);
+        g_assert(done);
+    }
+    qemu_coroutine_get_pool_stats(&after);
+
+    g_assert_cmpuint(after.pool_hits + after.allocations -
+                     before.pool_hits - before.allocations, ==, 100);
+    if (CONFIG_COROUTINE_POOL) {
+        /* One coroutine at a time is reused over and over */
+        g_assert_cmpuint(after.allocations - before.allocations, <=, 1);
+    }
+    g_assert_cmpuint(after.stack_size, >, 0);
+}
+
+/*
+ * Check that the pool shrinks back once a burst of coroutines is over
+ */
+
+static void coroutine_fn yield_once(void *opaque)
+{
+    qemu_coroutine_yield();
+}
+
+static void test_pool_decay(void)
+{
+    CoroutinePoolStats before, after;
+    Coroutine *burst[256];
+    bool done;
+    int i;
+
+    qemu_coroutine_get_pool_stats(&before);
+    for (i = 0; i < ARRAY_SIZE(burst); i++) {
+        burst[i] = qemu_coroutine_create(yield_once, NULL);
+        qemu_coroutine_enter(burst[i]);
+    }
+    for (i = 0; i < ARRAY_SIZE(burst); i++) {
+        qemu_coroutine_enter(burst[i]);
+    }
+
+    /* Enough one-at-a-time creations for more than two pool windows */
+    for (i = 0; i < 4096; i++) {
+        done = false;
+        qemu_coroutine_enter(qemu_coroutine_create(set_and_exit, &done));
+        g_assert(done);
+    }
+    qemu_coroutine_get_pool_stats(&after);
+
+    g_assert_cmpuint(after.frees - before.frees, >=, ARRAY_SIZE(burst) - 1);
+}
+
 
 #define RECORD_SIZE 10 /* Leave some room for expansion */
 struct coroutine_position {
@@ -495,6 +560,10 @@ int main(int argc, char **argv)
     }
 
     g_test_add_func("/basic/lifecycle", test_lifecycle);
+    g_test_add_func("/basic/pool-stats", test_pool_stats);
+    if (CONFIG_COROUTINE_POOL) {
+        g_test_add_func("/basic/pool-decay", test_pool_decay);
+    }
     g_test_add_func("/basic/yield", test_yield);
     g_test_add_func("/basic/nesting", test_nesting);
     g_test_add_func("/basic/self", test_self);
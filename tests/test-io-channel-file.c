@@ -23,6 +23,7 @@
 #include "io/channel-util.h"
 #include "io-channel-helpers.h"
 #include "qapi/error.h"
+#include "qemu/cutils.h"
 
 #define TEST_FILE "tests/test-io-channel-file.txt"
 #define TEST_MASK 0600
@@ -91,6 +92,45 @@ static void test_io_channel_fd(void)
 }
 
 
+#ifdef CONFIG_PREADV
+static void test_io_channel_file_pwritev(void)
+{
+    QIOChannel *ioc;
+    char buf[4] = { 0 };
+    struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+    ssize_t ret;
+
+    unlink(TEST_FILE);
+    ioc = QIO_CHANNEL(qio_channel_file_new_path(
+                          TEST_FILE,
+                          O_RDWR | O_CREAT | O_TRUNC | O_BINARY, TEST_MASK,
+                          &error_abort));
+    g_assert(qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_SEEKABLE));
+
+    /* Writes at an offset leave the I/O position alone */
+    memcpy(buf, "abcd", sizeof(buf));
+    ret = qio_channel_pwritev(ioc, &iov, 1, 4096, &error_abort);
+    g_assert_cmpint(ret, ==, sizeof(buf));
+    g_assert_cmpint(qio_channel_io_seek(ioc, 0, SEEK_CUR, &error_abort),
+                    ==, 0);
+
+    memset(buf, 0, sizeof(buf));
+    ret = qio_channel_preadv(ioc, &iov, 1, 4096, &error_abort);
+    g_assert_cmpint(ret, ==, sizeof(buf));
+    g_assert(memcmp(buf, "abcd", sizeof(buf)) == 0);
+
+    /* The hole before it reads back as zeroes */
+    memset(buf, 0xff, sizeof(buf));
+    ret = qio_channel_preadv(ioc, &iov, 1, 0, &error_abort);
+    g_assert_cmpint(ret, ==, sizeof(buf));
+    g_assert(buffer_is_zero(buf, sizeof(buf)));
+
+    unlink(TEST_FILE);
+    object_unref(OBJECT(ioc));
+}
+#endif
+
+
 #ifndef _WIN32
 static void test_io_channel_pipe(bool async)
 {
@@ -136,6 +176,9 @@ int main(int argc, char **argv)
     g_test_add_func("/io/channel/file", test_io_channel_file);
     g_test_add_func("/io/channel/file/rdwr", test_io_channel_file_rdwr);
     g_test_add_func("/io/channel/file/fd", test_io_channel_fd);
+#ifdef CONFIG_PREADV
+    g_test_add_func("/io/channel/file/pwritev", test_io_channel_file_pwritev);
+#endif
 #ifndef _WIN32
     g_test_add_func("/io/channel/pipe/sync", test_io_channel_pipe_sync);
     g_test_add_func("/io/channel/pipe/async", test_io_channel_pipe_async);
@@ -0,0 +1,199 @@
+/*
+ * Timer list microbenchmark
+ *
+ * Re-arms timers picked at random out of a set of pending ones, as
+ * per-vCPU APIC timers or network coalescing timers do, first through
+ * QEMUTimerList and then through a sorted singly-linked list like the
+ * one QEMUTimerList used to be.  Both runs see the same deadlines.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+
+typedef struct ListTimer ListTimer;
+struct ListTimer {
+    int64_t expire_time;
+    ListTimer *next;
+};
+
+static unsigned int n_timers = 256;
+static unsigned long n_ops = 10000000;
+static uint64_t seed = 1;
+
+static const char commands_string[] =
+    " -n = number of pending timers\n"
+    " -o = number of re-arm operations\n"
+    " -s = seed for the timers and deadlines";
+
+static void usage_complete(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+}
+
+/*
+ * From: https://en.wikipedia.org/wiki/Xorshift
+ * This is faster than rand_r(), and gives us a wider range (RAND_MAX is only
+ * guaranteed to be >= INT_MAX).
+ */
+static uint64_t xorshift64star(uint64_t x)
+{
+    x ^= x >> 12; /* a */
+    x ^= x << 25; /* b */
+    x ^= x >> 27; /* c */
+    return x * UINT64_C(2685821657736338717);
+}
+
+/* Deadlines are spread over a second, a common range for device timers */
+static int64_t next_deadline(uint64_t *r)
+{
+    *r = xorshift64star(*r);
+    return *r % NANOSECONDS_PER_SECOND;
+}
+
+static unsigned int next_timer(uint64_t *r)
+{
+    *r = xorshift64star(*r);
+    return *r % n_timers;
+}
+
+static void list_del(ListTimer **head, ListTimer *ts)
+{
+    ListTimer **pt;
+
+    for (pt = head; *pt; pt = &(*pt)->next) {
+        if (*pt == ts) {
+            *pt = ts->next;
+            break;
+        }
+    }
+}
+
+static void list_mod(ListTimer **head, ListTimer *ts, int64_t expire_time)
+{
+    ListTimer **pt;
+
+    list_del(head, ts);
+    pt = head;
+    while (*pt && (*pt)->expire_time <= expire_time) {
+        pt = &(*pt)->next;
+    }
+    ts->expire_time = expire_time;
+    ts->next = *pt;
+    *pt = ts;
+}
+
+static int64_t bench_list(void)
+{
+    ListTimer *timers = g_new0(ListTimer, n_timers);
+    ListTimer *head = NULL;
+    uint64_t r = seed;
+    int64_t start, elapsed;
+    unsigned long i;
+
+    for (i = 0; i < n_timers; i++) {
+        list_mod(&head, &timers[i], next_deadline(&r));
+    }
+
+    start = get_clock();
+    for (i = 0; i < n_ops; i++) {
+        ListTimer *ts = &timers[next_timer(&r)];
+
+        list_mod(&head, ts, next_deadline(&r));
+    }
+    elapsed = get_clock() - start;
+
+    g_free(timers);
+    return elapsed;
+}
+
+static void timer_cb(void *opaque)
+{
+}
+
+static int64_t bench_timerlist(void)
+{
+    QEMUTimer *timers = g_new0(QEMUTimer, n_timers);
+    uint64_t r = seed;
+    int64_t start, elapsed;
+    unsigned long i;
+
+    for (i = 0; i < n_timers; i++) {
+        timer_init_ns(&timers[i], QEMU_CLOCK_REALTIME, timer_cb, NULL);
+        timer_mod_ns(&timers[i], next_deadline(&r));
+    }
+
+    start = get_clock();
+    for (i = 0; i < n_ops; i++) {
+        QEMUTimer *ts = &timers[next_timer(&r)];
+
+        timer_mod_ns(ts, next_deadline(&r));
+    }
+    elapsed = get_clock() - start;
+
+    for (i = 0; i < n_timers; i++) {
+        timer_del(&timers[i]);
+        timer_deinit(&timers[i]);
+    }
+    g_free(timers);
+    return elapsed;
+}
+
+static void pr_params(void)
+{
+    printf("Parameters:\n");
+    printf(" # of timers:       %u\n", n_timers);
+    printf(" # of operations:   %lu\n", n_ops);
+    printf(" seed:              %" PRIu64 "\n", seed);
+}
+
+static void pr_result(const char *name, int64_t elapsed)
+{
+    printf(" %-18s %.2f Mops/s (%.1f ns/op)\n", name,
+           n_ops * 1e3 / elapsed, (double)elapsed / n_ops);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "hn:o:s:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'h':
+            usage_complete(argv);
+            exit(0);
+        case 'n':
+            n_timers = MAX(atoi(optarg), 1);
+            break;
+        case 'o':
+            n_ops = atol(optarg);
+            break;
+        case 's':
+            seed = MAX(atoll(optarg), 1);
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int64_t list_ns, timerlist_ns;
+
+    parse_args(argc, argv);
+    init_clocks(NULL);
+    pr_params();
+
+    timerlist_ns = bench_timerlist();
+    list_ns = bench_list();
+
+    printf("Results:\n");
+    pr_result("QEMUTimerList:", timerlist_ns);
+    pr_result("sorted list:", list_ns);
+    return 0;
+}
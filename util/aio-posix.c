@@ -36,15 +36,47 @@ struct AioHandler
     void *opaque;
     bool is_external;
     QLIST_ENTRY(AioHandler) node;
+
+    /* Busy polling statistics, read by aio_context_get_poll_stats() */
+    unsigned long poll_hits;      /* windows in which io_poll made progress */
+    unsigned long poll_misses;    /* windows that ended without it */
+    unsigned int poll_hit_ns;     /* moving average of the time to a hit */
+    unsigned int poll_idle_windows; /* consecutive misses */
+    bool poll_hit;                /* io_poll made progress in this window */
+    bool poll_idle;               /* left out of busy polling */
+    bool poll_started;            /* io_poll_begin was called */
 };
 
+/*
+ * A handler whose io_poll has not made progress in this many busy polling
+ * windows in a row is left out of busy polling, and is watched through its
+ * file descriptor until that fires again.  An idle disk then no longer
+ * adds to the cost of every polling iteration.
+ */
+#define POLL_IDLE_WINDOWS 64
+
+/*
+ * While busy polling makes progress, aio_poll() does not look at file
+ * descriptors at all, so idle handlers are polled once every this many
+ * windows instead.
+ */
+#define POLL_IDLE_CHECK_WINDOWS 16
+
+/* The busy polling CPU budget of an AioContext is enforced per period */
+#define POLL_BUDGET_PERIOD_NS (100 * SCALE_MS)
+
 #ifdef CONFIG_EPOLL_CREATE1
 
 /* The fd number threshold to switch to epoll */
 #define EPOLL_ENABLE_THRESHOLD 64
 
+static void aio_epoll_source_disable(AioContext *ctx);
+
 static void aio_epoll_disable(AioContext *ctx)
 {
+    if (ctx->epoll_source) {
+        aio_epoll_source_disable(ctx);
+    }
     ctx->epoll_enabled = false;
     if (!ctx->epoll_available) {
         return;
@@ -162,6 +194,81 @@ static bool aio_epoll_check_poll(AioContext *ctx, GPollFD *pfds,
     return false;
 }
 
+/*
+ * When glib runs the AioContext, as the main loop does, the GSource starts
+ * out with one GPollFD per handler, and all of them go to ppoll(2) on every
+ * iteration.  With many handlers, the GSource polls the epoll fd instead,
+ * and the handlers' revents are filled in from epoll_wait(2) when glib
+ * checks the GSource.
+ *
+ * Called with list_lock taken.
+ */
+static void aio_epoll_source_enable(AioContext *ctx)
+{
+    AioHandler *node;
+
+    QLIST_FOREACH(node, &ctx->aio_handlers, node) {
+        if (!node->deleted) {
+            g_source_remove_poll(&ctx->source, &node->pfd);
+        }
+    }
+    ctx->epoll_pfd.fd = ctx->epollfd;
+    ctx->epoll_pfd.events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+    ctx->epoll_pfd.revents = 0;
+    g_source_add_poll(&ctx->source, &ctx->epoll_pfd);
+    ctx->epoll_source = true;
+}
+
+static void aio_epoll_source_disable(AioContext *ctx)
+{
+    AioHandler *node;
+
+    ctx->epoll_source = false;
+
+    /* See aio_set_fd_handler() */
+    if (g_source_is_destroyed(&ctx->source)) {
+        return;
+    }
+    g_source_remove_poll(&ctx->source, &ctx->epoll_pfd);
+    QLIST_FOREACH(node, &ctx->aio_handlers, node) {
+        if (!node->deleted) {
+            g_source_add_poll(&ctx->source, &node->pfd);
+        }
+    }
+}
+
+static void aio_epoll_source_prepare(AioContext *ctx)
+{
+    AioHandler *node;
+    unsigned n = 0;
+
+    if (!ctx->epoll_available || ctx->epoll_source) {
+        return;
+    }
+
+    qemu_lockcnt_lock(&ctx->list_lock);
+    QLIST_FOREACH(node, &ctx->aio_handlers, node) {
+        if (!node->deleted && ++n == EPOLL_ENABLE_THRESHOLD) {
+            break;
+        }
+    }
+    if (n == EPOLL_ENABLE_THRESHOLD) {
+        if (ctx->epoll_enabled || aio_epoll_try_enable(ctx)) {
+            aio_epoll_source_enable(ctx);
+        } else {
+            aio_epoll_disable(ctx);
+        }
+    }
+    qemu_lockcnt_unlock(&ctx->list_lock);
+}
+
+static void aio_epoll_source_check(AioContext *ctx)
+{
+    if (ctx->epoll_source && ctx->epoll_pfd.revents) {
+        aio_epoll(ctx, &ctx->epoll_pfd, 1, 0);
+    }
+}
+
 #else
 
 static void aio_epoll_update(AioContext *ctx, AioHandler *node, bool is_new)
@@ -185,6 +292,14 @@ static bool aio_epoll_check_poll(AioContext *ctx, GPollFD *pfds,
     return false;
 }
 
+static void aio_epoll_source_prepare(AioContext *ctx)
+{
+}
+
+static void aio_epoll_source_check(AioContext *ctx)
+{
+}
+
 #endif
 
 static AioHandler *find_aio_handler(AioContext *ctx, int fd)
@@ -229,7 +344,7 @@ void aio_set_fd_handler(AioContext *ctx,
          * removal in that case, because glib cleans up its state during
          * destruction anyway.
          */
-        if (!g_source_is_destroyed(&ctx->source)) {
+        if (!g_source_is_destroyed(&ctx->source) && !ctx->epoll_source) {
             g_source_remove_poll(&ctx->source, &node->pfd);
         }
 
@@ -254,7 +369,9 @@ void aio_set_fd_handler(AioContext *ctx,
             node->pfd.fd = fd;
             QLIST_INSERT_HEAD_RCU(&ctx->aio_handlers, node, node);
 
-            g_source_add_poll(&ctx->source, &node->pfd);
+            if (!ctx->epoll_source) {
+                g_source_add_poll(&ctx->source, &node->pfd);
+            }
             is_new = true;
         }
 
@@ -321,6 +438,27 @@ void aio_set_event_notifier_poll(AioContext *ctx,
                     (IOHandler *)io_poll_end);
 }
 
+static void poll_node_set_started(AioHandler *node, bool started)
+{
+    IOHandler *fn;
+
+    if (started == node->poll_started) {
+        return;
+    }
+
+    node->poll_started = started;
+
+    if (started) {
+        fn = node->io_poll_begin;
+    } else {
+        fn = node->io_poll_end;
+    }
+
+    if (fn) {
+        fn(node->opaque);
+    }
+}
+
 static void poll_set_started(AioContext *ctx, bool started)
 {
     AioHandler *node;
@@ -333,31 +471,31 @@ static void poll_set_started(AioContext *ctx, bool started)
 
     qemu_lockcnt_inc(&ctx->list_lock);
     QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
-        IOHandler *fn;
-
         if (node->deleted) {
             continue;
         }
 
-        if (started) {
-            fn = node->io_poll_begin;
-        } else {
-            fn = node->io_poll_end;
-        }
-
-        if (fn) {
-            fn(node->opaque);
-        }
+        poll_node_set_started(node, started && !node->poll_idle);
     }
     qemu_lockcnt_dec(&ctx->list_lock);
 }
 
+/* An idle handler has fired through its file descriptor, poll it again */
+static void poll_node_wake(AioContext *ctx, AioHandler *node)
+{
+    atomic_set(&node->poll_idle, false);
+    node->poll_idle_windows = 0;
+    poll_node_set_started(node, ctx->poll_started);
+    trace_poll_node_wake(ctx, node->pfd.fd);
+}
+
 
 bool aio_prepare(AioContext *ctx)
 {
     /* Poll mode cannot be used with glib's event loop, disable it. */
     poll_set_started(ctx, false);
 
+    aio_epoll_source_prepare(ctx);
     return false;
 }
 
@@ -372,6 +510,9 @@ bool aio_pending(AioContext *ctx)
      */
     qemu_lockcnt_inc(&ctx->list_lock);
 
+    /* glib only polled the epoll fd, find out which handlers are ready */
+    aio_epoll_source_check(ctx);
+
     QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
         int revents;
 
@@ -407,6 +548,9 @@ static bool aio_dispatch_handlers(AioContext *ctx)
             (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR)) &&
             aio_node_check(ctx, node->is_external) &&
             node->io_read) {
+            if (node->poll_idle) {
+                poll_node_wake(ctx, node);
+            }
             node->io_read(node->opaque);
 
             /* aio_notify() does not count as progress */
@@ -490,18 +634,38 @@ static void add_pollfd(AioHandler *node)
     npfd++;
 }
 
-static bool run_poll_handlers_once(AioContext *ctx, int64_t *timeout)
+/* run_poll_handlers_once:
+ * @ctx: the AioContext
+ * @start_time: when the busy polling window started, or 0 outside busy
+ *    polling
+ * @timeout: set to 0 if progress was made
+ *
+ * Outside busy polling, idle handlers are polled too: a non-blocking
+ * aio_poll() relies on this to skip the system call.
+ */
+static bool run_poll_handlers_once(AioContext *ctx, int64_t start_time,
+                                   int64_t *timeout)
 {
     bool progress = false;
     AioHandler *node;
 
     QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
         if (!node->deleted && node->io_poll &&
+            !(start_time && node->poll_idle) &&
             aio_node_check(ctx, node->is_external) &&
             node->io_poll(node->opaque)) {
             *timeout = 0;
             if (node->opaque != &ctx->notifier) {
                 progress = true;
+                if (start_time && !node->poll_hit) {
+                    int64_t ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) -
+                                 start_time;
+
+                    node->poll_hit = true;
+                    atomic_set(&node->poll_hit_ns,
+                               node->poll_hit_ns -
+                               node->poll_hit_ns / 8 + (unsigned int)ns / 8);
+                }
             }
         }
 
@@ -511,6 +675,72 @@ static bool run_poll_handlers_once(AioContext *ctx, int64_t *timeout)
     return progress;
 }
 
+/* Update the statistics of each handler at the end of a polling window.
+ * Returns true if a handler that was just left out of busy polling turned
+ * out to be ready.
+ */
+static bool poll_update_handlers(AioContext *ctx, int64_t *timeout)
+{
+    bool progress = false;
+    AioHandler *node;
+
+    QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
+        if (node->deleted || !node->io_poll || node->poll_idle ||
+            node->opaque == &ctx->notifier) {
+            continue;
+        }
+
+        if (node->poll_hit) {
+            node->poll_hit = false;
+            node->poll_idle_windows = 0;
+            atomic_set(&node->poll_hits, node->poll_hits + 1);
+            continue;
+        }
+
+        atomic_set(&node->poll_misses, node->poll_misses + 1);
+        if (++node->poll_idle_windows < POLL_IDLE_WINDOWS) {
+            continue;
+        }
+
+        atomic_set(&node->poll_idle, true);
+        trace_poll_node_idle(ctx, node->pfd.fd);
+        if (node->poll_started) {
+            /* Poll one last time, like try_poll_mode() does, in case an
+             * event arrived while notifications were off.
+             */
+            poll_node_set_started(node, false);
+            if (aio_node_check(ctx, node->is_external) &&
+                node->io_poll(node->opaque)) {
+                *timeout = 0;
+                progress = true;
+            }
+        }
+    }
+
+    return progress;
+}
+
+/* Poll the handlers that were left out of busy polling once, and bring
+ * back those that have work.
+ */
+static bool poll_idle_handlers(AioContext *ctx, int64_t *timeout)
+{
+    bool progress = false;
+    AioHandler *node;
+
+    QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
+        if (!node->deleted && node->io_poll && node->poll_idle &&
+            aio_node_check(ctx, node->is_external) &&
+            node->io_poll(node->opaque)) {
+            poll_node_wake(ctx, node);
+            *timeout = 0;
+            progress = true;
+        }
+    }
+
+    return progress;
+}
+
 /* run_poll_handlers:
  * @ctx: the AioContext
  * @max_ns: maximum time to poll for, in nanoseconds
@@ -536,11 +766,18 @@ static bool run_poll_handlers(AioContext *ctx, int64_t max_ns, int64_t *timeout)
 
     start_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     do {
-        progress = run_poll_handlers_once(ctx, timeout);
+        progress = run_poll_handlers_once(ctx, start_time, timeout);
         elapsed_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_time;
     } while (!progress && elapsed_time < max_ns
              && !atomic_read(&ctx->poll_disable_cnt));
 
+    progress |= poll_update_handlers(ctx, timeout);
+    if (++ctx->poll_idle_check == POLL_IDLE_CHECK_WINDOWS) {
+        ctx->poll_idle_check = 0;
+        progress |= poll_idle_handlers(ctx, timeout);
+    }
+    ctx->poll_budget_used_ns += elapsed_time;
+
     /* If time has passed with no successful polling, adjust *timeout to
      * keep the same ending time.
      */
@@ -552,6 +789,19 @@ static bool run_poll_handlers(AioContext *ctx, int64_t max_ns, int64_t *timeout)
     return progress;
 }
 
+/* How long busy polling may go on before the CPU budget is exhausted */
+static int64_t poll_budget_left(AioContext *ctx)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+    if (now - ctx->poll_budget_start >= POLL_BUDGET_PERIOD_NS) {
+        ctx->poll_budget_start = now;
+        ctx->poll_budget_used_ns = 0;
+    }
+    return MAX(POLL_BUDGET_PERIOD_NS / 100 * ctx->poll_budget -
+               ctx->poll_budget_used_ns, 0);
+}
+
 /* try_poll_mode:
  * @ctx: the AioContext
  * @timeout: timeout for blocking wait, computed by the caller and updated if
@@ -568,6 +818,10 @@ static bool try_poll_mode(AioContext *ctx, int64_t *timeout)
     /* See qemu_soonest_timeout() uint64_t hack */
     int64_t max_ns = MIN((uint64_t)*timeout, (uint64_t)ctx->poll_ns);
 
+    if (max_ns && ctx->poll_budget) {
+        max_ns = MIN(max_ns, poll_budget_left(ctx));
+    }
+
     if (max_ns && !atomic_read(&ctx->poll_disable_cnt)) {
         poll_set_started(ctx, true);
 
@@ -581,7 +835,7 @@ static bool try_poll_mode(AioContext *ctx, int64_t *timeout)
     /* Even if we don't run busy polling, try polling once in case it can make
      * progress and the caller will be able to avoid ppoll(2)/epoll_wait(2).
      */
-    return run_poll_handlers_once(ctx, timeout);
+    return run_poll_handlers_once(ctx, 0, timeout);
 }
 
 bool aio_poll(AioContext *ctx, bool blocking)
@@ -748,3 +1002,45 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
 
     aio_notify(ctx);
 }
+
+void aio_context_set_poll_budget(AioContext *ctx, int64_t budget,
+                                 Error **errp)
+{
+    if (budget > 100) {
+        error_setg(errp, "poll-budget value must be in range [0, 100]");
+        return;
+    }
+
+    /* As above, an incorrect value used once does not matter */
+    ctx->poll_budget = budget;
+    aio_notify(ctx);
+}
+
+AioPollHandlerStats *aio_context_get_poll_stats(AioContext *ctx,
+                                                unsigned int *count)
+{
+    AioPollHandlerStats *stats = NULL;
+    AioHandler *node;
+    unsigned int n = 0;
+
+    qemu_lockcnt_inc(&ctx->list_lock);
+    QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
+        if (node->deleted || !node->io_poll ||
+            node->opaque == &ctx->notifier) {
+            continue;
+        }
+
+        stats = g_renew(AioPollHandlerStats, stats, n + 1);
+        stats[n++] = (AioPollHandlerStats) {
+            .fd = node->pfd.fd,
+            .idle = atomic_read(&node->poll_idle),
+            .hits = atomic_read(&node->poll_hits),
+            .misses = atomic_read(&node->poll_misses),
+            .avg_hit_ns = atomic_read(&node->poll_hit_ns),
+        };
+    }
+    qemu_lockcnt_dec(&ctx->list_lock);
+
+    *count = n;
+    return stats;
+}
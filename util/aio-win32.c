@@ -419,3 +419,18 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
         error_setg(errp, "AioContext polling is not implemented on Windows");
     }
 }
+
+void aio_context_set_poll_budget(AioContext *ctx, int64_t budget,
+                                 Error **errp)
+{
+    if (budget) {
+        error_setg(errp, "AioContext polling is not implemented on Windows");
+    }
+}
+
+AioPollHandlerStats *aio_context_get_poll_stats(AioContext *ctx,
+                                                unsigned int *count)
+{
+    *count = 0;
+    return NULL;
+}
@@ -258,6 +258,13 @@ void qemu_coroutine_delete(Coroutine *co_)
     g_free(co);
 }
 
+size_t qemu_coroutine_stack_usage(Coroutine *co_)
+{
+    CoroutineSigAltStack *co = DO_UPCAST(CoroutineSigAltStack, base, co_);
+
+    return qemu_stack_usage(co->stack, co->stack_size);
+}
+
 CoroutineAction qemu_coroutine_switch(Coroutine *from_, Coroutine *to_,
                                       CoroutineAction action)
 {
@@ -196,6 +196,13 @@ void qemu_coroutine_delete(Coroutine *co_)
     g_free(co);
 }
 
+size_t qemu_coroutine_stack_usage(Coroutine *co_)
+{
+    CoroutineUContext *co = DO_UPCAST(CoroutineUContext, base, co_);
+
+    return qemu_stack_usage(co->stack, co->stack_size);
+}
+
 /* This function is marked noinline to prevent GCC from inlining it
  * into coroutine_trampoline(). If we allow it to do that then it
  * hoists the code to get the address of the TLS variable "current"
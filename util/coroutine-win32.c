@@ -87,6 +87,11 @@ void qemu_coroutine_delete(Coroutine *co_)
     g_free(co);
 }
 
+size_t qemu_coroutine_stack_usage(Coroutine *co_)
+{
+    return 0;
+}
+
 Coroutine *qemu_coroutine_self(void)
 {
     if (!current) {
@@ -679,6 +679,31 @@ void qemu_free_stack(void *stack, size_t sz)
     munmap(stack, sz);
 }
 
+size_t qemu_stack_usage(void *stack, size_t sz)
+{
+#if defined(CONFIG_LINUX) && !defined(CONFIG_DEBUG_STACK_USAGE)
+    /*
+     * The stack is only backed by memory where it has been touched, so
+     * count its resident pages.  Pages that were swapped out are missed.
+     */
+    size_t pagesz = getpagesize();
+    size_t npages = sz / pagesz;
+    unsigned char *vec = g_malloc(npages);
+    size_t i, usage = 0;
+
+    if (mincore(stack, sz, vec) == 0) {
+        for (i = 0; i < npages; i++) {
+            usage += (vec[i] & 1) * pagesz;
+        }
+    }
+    g_free(vec);
+    return usage;
+#else
+    /* CONFIG_DEBUG_STACK_USAGE touches the whole stack at allocation */
+    return 0;
+#endif
+}
+
 void sigaction_invoke(struct sigaction *action,
                       struct qemu_signalfd_siginfo *info)
 {
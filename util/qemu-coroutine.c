@@ -23,6 +23,12 @@
 
 enum {
     POOL_BATCH_SIZE = 64,
+    /* Upper bound on the coroutines a thread keeps for itself */
+    POOL_MAX_SIZE = 1024,
+    /* Resize a thread's pool once every this many creations */
+    POOL_WINDOW = POOL_MAX_SIZE,
+    /* Sample the stack usage once every this many terminations */
+    STACK_SAMPLE_INTERVAL = 256,
 };
 
 /** Free list to speed up creation */
@@ -32,6 +38,60 @@ static __thread QSLIST_HEAD(, Coroutine) alloc_pool = QSLIST_HEAD_INITIALIZER(po
 static __thread unsigned int alloc_pool_size;
 static __thread Notifier coroutine_pool_cleanup_notifier;
 
+/*
+ * Each thread keeps up to as many terminated coroutines as it had running
+ * at the same time during the last window of POOL_WINDOW creations, so
+ * that an iothread serving a deep queue does not go through release_pool
+ * (shared by all threads) for every request.  When the load drops, the
+ * next window shrinks the pool and frees the surplus.
+ *
+ * Coroutines can be created in one thread and terminate in another, hence
+ * the signed count.  Such coroutines are never subtracted from their
+ * creator's count, so the limit is also capped by the terminations seen in
+ * the window: only those can refill the pool.  A thread that only creates
+ * coroutines keeps no pool, and one that only terminates them feeds
+ * release_pool instead.
+ */
+static __thread int coroutines_in_use;
+static __thread unsigned int alloc_pool_max;
+static __thread unsigned int window_creations;
+static __thread unsigned int window_terminations;
+static __thread unsigned int window_peak;
+
+/* Pool hits are counted per thread and added up in batches */
+static __thread unsigned int pool_hits;
+static __thread unsigned int terminations;
+static CoroutinePoolStats pool_stats;
+
+static void coroutine_update_stack_usage(Coroutine *co)
+{
+    size_t usage = qemu_coroutine_stack_usage(co);
+    size_t old = atomic_read(&pool_stats.max_stack_usage);
+
+    while (usage > old) {
+        size_t prev = atomic_cmpxchg(&pool_stats.max_stack_usage, old, usage);
+        if (prev == old) {
+            break;
+        }
+        old = prev;
+    }
+}
+
+static void coroutine_flush_pool_hits(void)
+{
+    if (pool_hits) {
+        atomic_add(&pool_stats.pool_hits, pool_hits);
+        pool_hits = 0;
+    }
+}
+
+static void coroutine_free(Coroutine *co)
+{
+    coroutine_update_stack_usage(co);
+    atomic_inc(&pool_stats.frees);
+    qemu_coroutine_delete(co);
+}
+
 static void coroutine_pool_cleanup(Notifier *n, void *value)
 {
     Coroutine *co;
@@ -39,7 +99,34 @@ static void coroutine_pool_cleanup(Notifier *n, void *value)
 
     QSLIST_FOREACH_SAFE(co, &alloc_pool, pool_next, tmp) {
         QSLIST_REMOVE_HEAD(&alloc_pool, pool_next);
-        qemu_coroutine_delete(co);
+        coroutine_free(co);
+    }
+    coroutine_flush_pool_hits();
+}
+
+/* Size the pool after the window that just ended and start a new one */
+static void coroutine_pool_end_window(void)
+{
+    Coroutine *co;
+
+    alloc_pool_max = MIN(window_peak, window_terminations);
+    while (alloc_pool_size > alloc_pool_max &&
+           (co = QSLIST_FIRST(&alloc_pool)) != NULL) {
+        QSLIST_REMOVE_HEAD(&alloc_pool, pool_next);
+        alloc_pool_size--;
+        coroutine_free(co);
+    }
+
+    window_peak = MIN(MAX(coroutines_in_use, 0), POOL_MAX_SIZE);
+    window_creations = 0;
+    window_terminations = 0;
+}
+
+static void coroutine_pool_register_cleanup(void)
+{
+    if (!coroutine_pool_cleanup_notifier.notify) {
+        coroutine_pool_cleanup_notifier.notify = coroutine_pool_cleanup;
+        qemu_thread_atexit_add(&coroutine_pool_cleanup_notifier);
     }
 }
 
@@ -48,14 +135,18 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
     Coroutine *co = NULL;
 
     if (CONFIG_COROUTINE_POOL) {
+        if (++coroutines_in_use > (int)window_peak) {
+            window_peak = MIN(coroutines_in_use, POOL_MAX_SIZE);
+        }
+        if (++window_creations == POOL_WINDOW) {
+            coroutine_pool_end_window();
+        }
+
         co = QSLIST_FIRST(&alloc_pool);
         if (!co) {
             if (release_pool_size > POOL_BATCH_SIZE) {
                 /* Slow path; a good place to register the destructor, too.  */
-                if (!coroutine_pool_cleanup_notifier.notify) {
-                    coroutine_pool_cleanup_notifier.notify = coroutine_pool_cleanup;
-                    qemu_thread_atexit_add(&coroutine_pool_cleanup_notifier);
-                }
+                coroutine_pool_register_cleanup();
 
                 /* This is not exact; there could be a little skew between
                  * release_pool_size and the actual size of release_pool.  But
@@ -69,11 +160,15 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
         if (co) {
             QSLIST_REMOVE_HEAD(&alloc_pool, pool_next);
             alloc_pool_size--;
+            if (++pool_hits == POOL_BATCH_SIZE) {
+                coroutine_flush_pool_hits();
+            }
         }
     }
 
     if (!co) {
         co = qemu_coroutine_new();
+        atomic_inc(&pool_stats.allocations);
     }
 
     co->entry = entry;
@@ -87,19 +182,42 @@ static void coroutine_delete(Coroutine *co)
     co->caller = NULL;
 
     if (CONFIG_COROUTINE_POOL) {
-        if (release_pool_size < POOL_BATCH_SIZE * 2) {
-            QSLIST_INSERT_HEAD_ATOMIC(&release_pool, co, pool_next);
-            atomic_inc(&release_pool_size);
-            return;
+        coroutines_in_use--;
+        if (window_terminations < POOL_MAX_SIZE) {
+            window_terminations++;
         }
-        if (alloc_pool_size < POOL_BATCH_SIZE) {
+        if (MIN(window_peak, window_terminations) > alloc_pool_max) {
+            alloc_pool_max = MIN(window_peak, window_terminations);
+        }
+        if (++terminations == STACK_SAMPLE_INTERVAL) {
+            coroutine_update_stack_usage(co);
+            terminations = 0;
+        }
+
+        if (alloc_pool_size < alloc_pool_max) {
+            coroutine_pool_register_cleanup();
             QSLIST_INSERT_HEAD(&alloc_pool, co, pool_next);
             alloc_pool_size++;
             return;
         }
+        if (release_pool_size < POOL_BATCH_SIZE * 2) {
+            QSLIST_INSERT_HEAD_ATOMIC(&release_pool, co, pool_next);
+            atomic_inc(&release_pool_size);
+            return;
+        }
     }
 
-    qemu_coroutine_delete(co);
+    coroutine_free(co);
+}
+
+void qemu_coroutine_get_pool_stats(CoroutinePoolStats *stats)
+{
+    coroutine_flush_pool_hits();
+    stats->pool_hits = atomic_read(&pool_stats.pool_hits);
+    stats->allocations = atomic_read(&pool_stats.allocations);
+    stats->frees = atomic_read(&pool_stats.frees);
+    stats->max_stack_usage = atomic_read(&pool_stats.max_stack_usage);
+    stats->stack_size = COROUTINE_STACK_SIZE;
 }
 
 void qemu_aio_coroutine_enter(AioContext *ctx, Coroutine *co)
@@ -68,7 +68,16 @@ static QEMUClock qemu_clocks[QEMU_CLOCK_MAX];
 struct QEMUTimerList {
     QEMUClock *clock;
     QemuMutex active_timers_lock;
+    /*
+     * Pending timers form a binary min-heap, ordered by expire_time and
+     * then by the order in which they were armed.  active_timers is the
+     * root, or NULL if the heap is empty; it can be read without the lock.
+     */
     QEMUTimer *active_timers;
+    QEMUTimer **heap;
+    size_t heap_len;
+    size_t heap_size;
+    uint64_t seq;
     QLIST_ENTRY(QEMUTimerList) list;
     QEMUTimerListNotifyCB *notify_cb;
     void *notify_opaque;
@@ -119,6 +128,7 @@ void timerlist_free(QEMUTimerList *timer_list)
         QLIST_REMOVE(timer_list, list);
     }
     qemu_mutex_destroy(&timer_list->active_timers_lock);
+    g_free(timer_list->heap);
     g_free(timer_list);
 }
 
@@ -361,43 +371,102 @@ void timer_deinit(QEMUTimer *ts)
     ts->timer_list = NULL;
 }
 
-static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
+static bool timer_heap_before(QEMUTimer *a, QEMUTimer *b)
 {
-    QEMUTimer **pt, *t;
+    return a->expire_time < b->expire_time ||
+           (a->expire_time == b->expire_time && a->seq < b->seq);
+}
 
-    ts->expire_time = -1;
-    pt = &timer_list->active_timers;
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t == ts) {
-            atomic_set(pt, t->next);
+static void timer_heap_set(QEMUTimerList *timer_list, size_t i,
+                           QEMUTimer *ts)
+{
+    timer_list->heap[i] = ts;
+    ts->heap_index = i;
+}
+
+static void timer_heap_up(QEMUTimerList *timer_list, size_t i)
+{
+    QEMUTimer *ts = timer_list->heap[i];
+
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+
+        if (!timer_heap_before(ts, timer_list->heap[parent])) {
             break;
         }
-        pt = &t->next;
+        timer_heap_set(timer_list, i, timer_list->heap[parent]);
+        i = parent;
     }
+    timer_heap_set(timer_list, i, ts);
 }
 
-static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
-                                QEMUTimer *ts, int64_t expire_time)
+static void timer_heap_down(QEMUTimerList *timer_list, size_t i)
 {
-    QEMUTimer **pt, *t;
+    QEMUTimer *ts = timer_list->heap[i];
 
-    /* add the timer in the sorted list */
-    pt = &timer_list->active_timers;
     for (;;) {
-        t = *pt;
-        if (!timer_expired_ns(t, expire_time)) {
+        size_t child = 2 * i + 1;
+
+        if (child >= timer_list->heap_len) {
             break;
         }
-        pt = &t->next;
+        if (child + 1 < timer_list->heap_len &&
+            timer_heap_before(timer_list->heap[child + 1],
+                              timer_list->heap[child])) {
+            child++;
+        }
+        if (!timer_heap_before(timer_list->heap[child], ts)) {
+            break;
+        }
+        timer_heap_set(timer_list, i, timer_list->heap[child]);
+        i = child;
+    }
+    timer_heap_set(timer_list, i, ts);
+}
+
+static void timer_heap_update_root(QEMUTimerList *timer_list)
+{
+    atomic_set(&timer_list->active_timers,
+               timer_list->heap_len ? timer_list->heap[0] : NULL);
+}
+
+static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    size_t i = ts->heap_index;
+    QEMUTimer *last;
+
+    if (ts->expire_time == -1) {
+        return;
     }
+    ts->expire_time = -1;
+
+    assert(i < timer_list->heap_len && timer_list->heap[i] == ts);
+    last = timer_list->heap[--timer_list->heap_len];
+    if (last != ts) {
+        timer_heap_set(timer_list, i, last);
+        timer_heap_up(timer_list, i);
+        timer_heap_down(timer_list, last->heap_index);
+    }
+    timer_heap_update_root(timer_list);
+}
+
+static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
+                                QEMUTimer *ts, int64_t expire_time)
+{
+    if (timer_list->heap_len == timer_list->heap_size) {
+        timer_list->heap_size = MAX(16, timer_list->heap_size * 2);
+        timer_list->heap = g_renew(QEMUTimer *, timer_list->heap,
+                                   timer_list->heap_size);
+    }
+
+    /* Timers with the same expire_time run in the order they were armed */
     ts->expire_time = MAX(expire_time, 0);
-    ts->next = *pt;
-    atomic_set(pt, ts);
+    ts->seq = timer_list->seq++;
+    timer_heap_set(timer_list, timer_list->heap_len++, ts);
+    timer_heap_up(timer_list, ts->heap_index);
+    timer_heap_update_root(timer_list);
 
-    return pt == &timer_list->active_timers;
+    return timer_list->active_timers == ts;
 }
 
 static void timerlist_rearm(QEMUTimerList *timer_list)
@@ -563,9 +632,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
         }
 
         /* remove timer from the list before calling the callback */
-        timer_list->active_timers = ts->next;
-        ts->next = NULL;
-        ts->expire_time = -1;
+        timer_del_locked(timer_list, ts);
         cb = ts->cb;
         opaque = ts->opaque;
 
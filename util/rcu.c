@@ -235,9 +235,56 @@ retry:
     return node;
 }
 
+/*
+ * Callbacks whose grace period has elapsed, waiting for the reclaim
+ * thread.  The call_rcu thread appends whole batches so that it can
+ * start the next grace period while the previous batch waits for the
+ * iothread lock; otherwise a busy iothread lock would hold up both.
+ */
+static struct {
+    QemuMutex lock;
+    QemuCond cond;
+    struct rcu_head *head, **tail;
+} rcu_reclaim;
+
+static void *rcu_reclaim_thread(void *opaque)
+{
+    struct rcu_head *node, *next;
+
+    rcu_register_thread();
+
+    for (;;) {
+        qemu_mutex_lock(&rcu_reclaim.lock);
+        while (!rcu_reclaim.head) {
+            qemu_cond_wait(&rcu_reclaim.cond, &rcu_reclaim.lock);
+        }
+        node = rcu_reclaim.head;
+        rcu_reclaim.head = NULL;
+        rcu_reclaim.tail = &rcu_reclaim.head;
+        qemu_mutex_unlock(&rcu_reclaim.lock);
+
+        qemu_mutex_lock_iothread();
+        for (; node; node = next) {
+            /* The callback usually frees node */
+            next = node->next;
+            node->func(node);
+        }
+        qemu_mutex_unlock_iothread();
+
+#if defined(CONFIG_MALLOC_TRIM)
+        /* Without holding rcu_reclaim.lock, which call_rcu_thread needs */
+        if (!atomic_read(&rcu_reclaim.head) &&
+            atomic_read(&rcu_call_count) == 0) {
+            malloc_trim(4 * 1024 * 1024);
+        }
+#endif
+    }
+    abort();
+}
+
 static void *call_rcu_thread(void *opaque)
 {
-    struct rcu_head *node;
+    struct rcu_head *node, *batch, **batch_tail;
 
     rcu_register_thread();
 
@@ -255,9 +302,6 @@ static void *call_rcu_thread(void *opaque)
                 qemu_event_reset(&rcu_call_ready_event);
                 n = atomic_read(&rcu_call_count);
                 if (n == 0) {
-#if defined(CONFIG_MALLOC_TRIM)
-                    malloc_trim(4 * 1024 * 1024);
-#endif
                     qemu_event_wait(&rcu_call_ready_event);
                 }
             }
@@ -266,24 +310,31 @@ static void *call_rcu_thread(void *opaque)
 
         atomic_sub(&rcu_call_count, n);
         synchronize_rcu();
-        qemu_mutex_lock_iothread();
+
+        batch_tail = &batch;
         while (n > 0) {
             node = try_dequeue();
             while (!node) {
-                qemu_mutex_unlock_iothread();
                 qemu_event_reset(&rcu_call_ready_event);
                 node = try_dequeue();
                 if (!node) {
                     qemu_event_wait(&rcu_call_ready_event);
                     node = try_dequeue();
                 }
-                qemu_mutex_lock_iothread();
             }
 
             n--;
-            node->func(node);
+            /* node is off the queue, so its next pointer is ours now */
+            *batch_tail = node;
+            batch_tail = &node->next;
         }
-        qemu_mutex_unlock_iothread();
+        *batch_tail = NULL;
+
+        qemu_mutex_lock(&rcu_reclaim.lock);
+        *rcu_reclaim.tail = batch;
+        rcu_reclaim.tail = batch_tail;
+        qemu_mutex_unlock(&rcu_reclaim.lock);
+        qemu_cond_signal(&rcu_reclaim.cond);
     }
     abort();
 }
@@ -321,11 +372,21 @@ static void rcu_init_complete(void)
 
     qemu_event_init(&rcu_call_ready_event, false);
 
-    /* The caller is assumed to have iothread lock, so the call_rcu thread
-     * must have been quiescent even after forking, just recreate it.
+    /* Callbacks that were ready at fork time are still run in the child */
+    qemu_mutex_init(&rcu_reclaim.lock);
+    qemu_cond_init(&rcu_reclaim.cond);
+    if (!rcu_reclaim.head) {
+        rcu_reclaim.tail = &rcu_reclaim.head;
+    }
+
+    /* The caller is assumed to have iothread lock, so the call_rcu and
+     * reclaim threads must have been quiescent even after forking, just
+     * recreate them.
      */
     qemu_thread_create(&thread, "call_rcu", call_rcu_thread,
                        NULL, QEMU_THREAD_DETACHED);
+    qemu_thread_create(&thread, "rcu_reclaim", rcu_reclaim_thread,
+                       NULL, QEMU_THREAD_DETACHED);
 
     rcu_register_thread();
 }
@@ -351,6 +412,7 @@ static void rcu_init_lock(void)
 
     qemu_mutex_lock(&rcu_sync_lock);
     qemu_mutex_lock(&rcu_registry_lock);
+    qemu_mutex_lock(&rcu_reclaim.lock);
 }
 
 static void rcu_init_unlock(void)
@@ -359,6 +421,7 @@ static void rcu_init_unlock(void)
         return;
     }
 
+    qemu_mutex_unlock(&rcu_reclaim.lock);
     qemu_mutex_unlock(&rcu_registry_lock);
     qemu_mutex_unlock(&rcu_sync_lock);
 }
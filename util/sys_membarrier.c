@@ -19,6 +19,25 @@ membarrier(int cmd, int flags)
 {
     return syscall(__NR_membarrier, cmd, flags);
 }
+
+/*
+ * MEMBARRIER_CMD_SHARED waits for a scheduler grace period and can take
+ * milliseconds; the private expedited command interrupts the CPUs that
+ * run our threads instead and returns in microseconds.
+ */
+static int membarrier_cmd = MEMBARRIER_CMD_SHARED;
+
+static void membarrier_register_expedited(void)
+{
+    int ret = membarrier(MEMBARRIER_CMD_QUERY, 0);
+
+    if (ret >= 0 && (ret & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+        membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0) {
+        membarrier_cmd = MEMBARRIER_CMD_PRIVATE_EXPEDITED;
+    } else {
+        membarrier_cmd = MEMBARRIER_CMD_SHARED;
+    }
+}
 #endif
 
 void smp_mb_global(void)
@@ -26,7 +45,7 @@ void smp_mb_global(void)
 #if defined CONFIG_WIN32
     FlushProcessWriteBuffers();
 #elif defined CONFIG_LINUX
-    membarrier(MEMBARRIER_CMD_SHARED, 0);
+    membarrier(membarrier_cmd, 0);
 #else
 #error --enable-membarrier is not supported on this operating system.
 #endif
@@ -46,5 +65,9 @@ void smp_mb_global_init(void)
         error_report("Please upgrade your system to a newer version of Linux");
         exit(1);
     }
+
+    /* The registration is per process, so a child must redo it.  */
+    membarrier_register_expedited();
+    pthread_atfork(NULL, NULL, membarrier_register_expedited);
 #endif
 }